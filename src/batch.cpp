@@ -0,0 +1,101 @@
+#include "batch.hpp"
+
+#include <algorithm>
+
+namespace chip8
+{
+    Batch::Batch(unsigned threads)
+    {
+        threads = std::max(threads, 1u);
+        for (unsigned i = 0; i < threads; ++i)
+            queues.emplace_back(new Queue);
+        for (unsigned i = 0; i < threads; ++i)
+            workers.emplace_back(&Batch::work, this, i);
+    }
+
+    Batch::~Batch()
+    {
+        {
+            const std::lock_guard<std::mutex> lock{mutex};
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    bool Batch::take(unsigned id, std::pair<std::size_t, std::size_t>& chunk) noexcept
+    {
+        {
+            Queue& own = *queues[id];
+            const std::lock_guard<std::mutex> lock{own.mutex};
+            if (!own.chunks.empty())
+            {
+                chunk = own.chunks.back();
+                own.chunks.pop_back();
+                return true;
+            }
+        }
+        for (std::size_t i = 1; i < queues.size(); ++i)
+        {
+            Queue& victim = *queues[(id + i) % queues.size()];
+            const std::lock_guard<std::mutex> lock{victim.mutex};
+            if (!victim.chunks.empty())
+            {
+                chunk = victim.chunks.front();
+                victim.chunks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Batch::work(unsigned id)
+    {
+        for (unsigned seen = 0;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                wake.wait(lock, [this, seen] {return stopping || generation != seen;});
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+
+            // no chunks are queued while a run is in progress, so empty queues mean this run is done
+            for (std::pair<std::size_t, std::size_t> chunk; take(id, chunk);)
+                for (std::size_t i = chunk.first; i < chunk.second; ++i)
+                    job(machines[i], job_cycles);
+
+            const std::lock_guard<std::mutex> lock{mutex};
+            if (!--busy)
+                finished.notify_all();
+        }
+    }
+
+    void Batch::dispatch(RunFunction run, std::uint64_t cycles)
+    {
+        // enough chunks per worker to even out ROMs that run at different speeds
+        const std::size_t chunk_size = std::max<std::size_t>(1,
+                std::min<std::size_t>(64, machines.size() / (queues.size() * 8)));
+        for (std::size_t first = 0, i = 0; first < machines.size(); first += chunk_size, ++i)
+            queues[i % queues.size()]->chunks.emplace_back(first, std::min(first + chunk_size, machines.size()));
+
+        std::unique_lock<std::mutex> lock{mutex};
+        job        = run;
+        job_cycles = cycles;
+        busy       = workers.size();
+        ++generation;
+        wake.notify_all();
+        finished.wait(lock, [this] {return !busy;});
+    }
+
+    std::vector<Batch::Result> Batch::results() const
+    {
+        std::vector<Result> results;
+        results.reserve(machines.size());
+        for (const Interpreter& machine : machines)
+            results.push_back({machine.display_hash(), machine.registers(), machine.cycles(), machine.wait()});
+        return results;
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef CHIP8_BATCH_HPP
+#define CHIP8_BATCH_HPP
+
+#include "chip8.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace chip8
+{
+    /*
+     * Owns many interpreters and advances all of them by the same virtual-time budget on a pool
+     * of worker threads. The machines are split into chunks; every worker drains its own queue
+     * from the back and steals from the front of the others once it runs dry.
+     */
+    class Batch
+    {
+    public:
+        struct Result
+        {
+            std::uint64_t display_hash;
+            Registers     registers;
+            std::uint64_t cycles;
+            bool          waiting;
+        };
+
+    private:
+        using RunFunction = void (*)(Interpreter& machine, std::uint64_t cycles);
+
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<std::pair<std::size_t, std::size_t>> chunks; // [first, last) machines
+        };
+
+        std::vector<Interpreter> machines;
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread>            workers;
+
+        std::mutex              mutex;
+        std::condition_variable wake, finished;
+        unsigned                generation = 0, busy = 0;
+        bool                    stopping   = false;
+
+        RunFunction   job        = nullptr;
+        std::uint64_t job_cycles = 0;
+
+        bool take(unsigned id, std::pair<std::size_t, std::size_t>& chunk) noexcept;
+        void work(unsigned id);
+        void dispatch(RunFunction run, std::uint64_t cycles);
+
+    public:
+        /*
+         * Under Dispatch::jit every machine maps its own 256 KB of executable code and about
+         * 70 KB of block tables; more machines than this are refused rather than mapping gigabytes.
+         */
+        static constexpr std::size_t max_jit_machines = 256;
+
+        explicit Batch(unsigned threads = std::thread::hardware_concurrency());
+        ~Batch();
+
+        Batch           (const Batch&) = delete;
+        Batch& operator=(const Batch&) = delete;
+
+        std::size_t add(Interpreter machine)
+        {
+            machines.push_back(std::move(machine));
+            return machines.size() - 1;
+        }
+
+        Interpreter&       operator[](std::size_t i)       noexcept {return machines[i];}
+        const Interpreter& operator[](std::size_t i) const noexcept {return machines[i];}
+
+        std::size_t size() const noexcept {return machines.size();}
+
+        // advances every machine by `cycles` slots, returns once all of them are done;
+        // throws std::length_error for Dispatch::jit on more than max_jit_machines machines
+        template<Dispatch D = Dispatch::switch_table>
+        void run(std::uint64_t cycles)
+        {
+            if (D == Dispatch::jit && machines.size() > max_jit_machines)
+                throw std::length_error{"the jit engine runs at most " + std::to_string(max_jit_machines) +
+                                        " machines in a batch, use threaded for more"};
+            dispatch([](Interpreter& machine, std::uint64_t cycles) noexcept {machine.run<D>(cycles);}, cycles);
+        }
+
+        std::vector<Result> results() const;
+    };
+}
+
+#endif
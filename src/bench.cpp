@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "input.hpp"
+
+namespace
+{
+    std::vector<unsigned char> load_binary_file(const std::string& filepath)
+    {
+        std::ifstream stream{filepath, std::ios::in | std::ios::binary};
+        if (!stream)
+            throw std::runtime_error{"file reading error: " + filepath};
+
+        stream.seekg(0, std::ios::end);
+        const auto size = stream.tellg();
+
+        stream.seekg(0, std::ios::beg);
+
+        std::vector<unsigned char> chars(size);
+        stream.read(reinterpret_cast<char*>(chars.data()), size);
+
+        return chars;
+    }
+
+    // a player mashing keys: a random key goes down every 4-20 frames and comes up 1-6 frames later
+    chip8::InputLog script(std::uint64_t cycles, unsigned cycles_per_tick)
+    {
+        chip8::InputLog log;
+        log.seed            = 1;
+        log.end_cycle       = cycles;
+        log.cycles_per_tick = cycles_per_tick;
+
+        std::uint64_t state = chip8::pcg32_seed(log.seed);
+        for (std::uint64_t cycle = 0;;)
+        {
+            cycle += (4 + chip8::pcg32(state) % 17) * cycles_per_tick;
+            if (cycle >= cycles)
+                break;
+            const auto key = static_cast<std::uint8_t>(chip8::pcg32(state) % 16);
+            log.events.push_back({cycle, key, true});
+            log.events.push_back({cycle + (1 + chip8::pcg32(state) % 6) * cycles_per_tick, key, false});
+        }
+        std::stable_sort(log.events.begin(), log.events.end(),
+                [](const chip8::InputEvent& a, const chip8::InputEvent& b) {return a.cycle < b.cycle;});
+        return log;
+    }
+
+    struct Sample
+    {
+        double        seconds;
+        std::uint64_t display_hash;
+    };
+
+    template<chip8::Dispatch D>
+    Sample run_once(const std::vector<unsigned char>& rom, const chip8::InputLog& log)
+    {
+        chip8::Interpreter machine;
+        machine.copy_font(chip8::fonts::original_chip8);
+        machine.copy_rom(rom.data(), rom.size());
+        machine.seed(log.seed);
+        machine.set_cycles_per_tick(log.cycles_per_tick);
+
+        chip8::InputQueue input;
+        input.replay(log);
+
+        const auto start = std::chrono::steady_clock::now();
+        input.run<D>(machine, log.end_cycle);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return {elapsed.count(), machine.display_hash()};
+    }
+
+    Sample run_once(const std::string& engine, const std::vector<unsigned char>& rom, const chip8::InputLog& log)
+    {
+        if      (engine == "switch")     return ::run_once<chip8::Dispatch::switch_table>(rom, log);
+        else if (engine == "predecoded") return ::run_once<chip8::Dispatch::predecoded  >(rom, log);
+        else if (engine == "threaded")   return ::run_once<chip8::Dispatch::threaded    >(rom, log);
+        else if (engine == "jit")        return ::run_once<chip8::Dispatch::jit         >(rom, log);
+        throw std::runtime_error{"unknown engine: " + engine};
+    }
+
+    struct Result
+    {
+        std::string   rom, engine;
+        std::uint64_t display_hash;
+        double        median, min, mean, stddev;  // ns per slot, an FX0A wait counting as one
+    };
+
+    Result measure(const std::string& rom_path, const std::string& engine, const std::vector<unsigned char>& rom,
+                   const chip8::InputLog& log, unsigned warmup, unsigned repetitions)
+    {
+        for (unsigned i = 0; i < warmup; ++i)
+            ::run_once(engine, rom, log);
+
+        std::vector<double> ns;
+        std::uint64_t display_hash = 0;
+        for (unsigned i = 0; i < repetitions; ++i)
+        {
+            const Sample sample = ::run_once(engine, rom, log);
+            if (i && sample.display_hash != display_hash)
+                throw std::runtime_error{engine + " is not deterministic on " + rom_path};
+            display_hash = sample.display_hash;
+            ns.push_back(sample.seconds * 1e9 / log.end_cycle);
+        }
+        std::sort(ns.begin(), ns.end());
+
+        double mean = 0, variance = 0;
+        for (double x : ns)
+            mean += x / ns.size();
+        for (double x : ns)
+            variance += (x - mean) * (x - mean) / ns.size();
+
+        const std::size_t mid = ns.size() / 2;
+        return {rom_path, engine, display_hash, ns.size() % 2 ? ns[mid] : (ns[mid - 1] + ns[mid]) / 2,
+                ns.front(), mean, std::sqrt(variance)};
+    }
+
+    void print_json(std::FILE* out, const std::vector<Result>& results, std::uint64_t cycles,
+                    unsigned cycles_per_tick, unsigned warmup, unsigned repetitions)
+    {
+        std::fprintf(out, "{\n  \"cycles\": %llu,\n  \"cycles_per_tick\": %u,\n  \"warmup\": %u,\n  \"repetitions\": %u,\n"
+                          "  \"results\": [\n", static_cast<unsigned long long>(cycles), cycles_per_tick, warmup, repetitions);
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            const Result& r = results[i];
+            std::fprintf(out, "    {\"rom\": \"%s\", \"engine\": \"%s\", \"display_hash\": \"%016llx\", "
+                              "\"slots_per_second\": %.0f, \"frames_per_second\": %.0f, "
+                              "\"ns_per_slot\": {\"median\": %.3f, \"min\": %.3f, \"mean\": %.3f, \"stddev\": %.3f}}%s\n",
+                    r.rom.c_str(), r.engine.c_str(), static_cast<unsigned long long>(r.display_hash),
+                    1e9 / r.median, 1e9 / r.median / cycles_per_tick, r.median, r.min, r.mean, r.stddev,
+                    i + 1 < results.size() ? "," : "");
+        }
+        std::fprintf(out, "  ]\n}\n");
+    }
+}
+
+// chip8-bench [-c cycles] [-w warmup] [-n repetitions] [-e engine]... [-j json-file] rom...
+// exits with 2 if the engines end a ROM on different displays
+int main(int argc, char* argv[])
+{
+    try
+    {
+        std::uint64_t cycles      = 600 * 60 * 5;  // five emulated minutes at 600 slots/s
+        unsigned      warmup      = 1;
+        unsigned      repetitions = 5;
+        std::string   json_path;
+
+        std::vector<std::string> engines, roms;
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg{argv[i]};
+            if ((arg == "-c" || arg == "-w" || arg == "-n" || arg == "-e" || arg == "-j") && i + 1 < argc)
+            {
+                const std::string value{argv[++i]};
+                if      (arg == "-c") cycles      = std::max<std::uint64_t>(std::stoull(value), 1);
+                else if (arg == "-w") warmup      = std::stoul(value);
+                else if (arg == "-n") repetitions = std::max(std::stoul(value), 1ul);
+                else if (arg == "-e") engines.push_back(value);
+                else                  json_path   = value;
+            }
+            else
+                roms.push_back(arg);
+        }
+        if (roms.empty())
+            throw std::runtime_error{"usage: chip8-bench [-c cycles] [-w warmup] [-n repetitions] [-e engine]... [-j json] rom..."};
+        if (engines.empty())
+            engines = {"switch", "predecoded", "threaded", "jit"};
+
+        constexpr unsigned cycles_per_tick = 10;
+        const chip8::InputLog log{::script(cycles, cycles_per_tick)};
+
+        std::printf("%-24s %-10s %10s %16s %12s  %s\n", "rom", "engine", "Mslots/s", "ns/slot (+-sd)", "frames/s", "display");
+        std::vector<Result> results;
+        bool mismatched = false;
+        for (const std::string& path : roms)
+        {
+            const std::vector<unsigned char> rom{::load_binary_file(path)};
+            const std::size_t first = results.size();
+            for (const std::string& engine : engines)
+            {
+                results.push_back(::measure(path, engine, rom, log, warmup, repetitions));
+                const Result& r = results.back();
+                mismatched |= r.display_hash != results[first].display_hash;
+                std::printf("%-24s %-10s %10.2f %8.2f (%5.2f) %12.0f  %016llx%s\n", path.c_str(), engine.c_str(),
+                        1e3 / r.median, r.median, r.stddev, 1e9 / r.median / cycles_per_tick,
+                        static_cast<unsigned long long>(r.display_hash),
+                        r.display_hash != results[first].display_hash ? " MISMATCH" : "");
+            }
+        }
+
+        // every ROM weighs the same, so a total is the mean time per slot over the corpus
+        std::printf("\n%-24s %-10s %10s %16s %12s\n", "total", "engine", "Mslots/s", "ns/slot", "frames/s");
+        for (const std::string& engine : engines)
+        {
+            double ns = 0;
+            std::size_t count = 0;
+            for (const Result& r : results)
+                if (r.engine == engine)
+                {
+                    ns += r.median;
+                    ++count;
+                }
+            ns /= count;
+            std::printf("%-24s %-10s %10.2f %16.2f %12.0f\n", "", engine.c_str(), 1e3 / ns, ns, 1e9 / ns / cycles_per_tick);
+        }
+
+        if (!json_path.empty())
+        {
+            std::FILE* const out = std::fopen(json_path.c_str(), "w");
+            if (!out)
+                throw std::runtime_error{"it is failed to write a file: " + json_path};
+            ::print_json(out, results, cycles, cycles_per_tick, warmup, repetitions);
+            std::fclose(out);
+        }
+
+        if (mismatched)
+            return 2;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "blit.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace chip8
+{
+    namespace
+    {
+        /*
+         * Eight output pixels of a scaled line: they come from at most two neighbouring display
+         * bytes, read as one 16-bit window, and `masks` picks each pixel's bit in that window.
+         */
+#if defined(__GNUC__)
+        typedef std::uint32_t Pixels __attribute__((vector_size(32)));
+
+#   if defined(__x86_64__) && defined(__linux__)
+#       define CHIP8_BLIT_KERNEL __attribute__((target_clones("avx2", "default")))
+#   else
+#       define CHIP8_BLIT_KERNEL
+#   endif
+
+        struct Group
+        {
+            Pixels   masks;
+            unsigned byte;
+        };
+
+        CHIP8_BLIT_KERNEL void expand_line(const unsigned char* row, const Group* groups, unsigned count,
+                std::uint32_t on, std::uint32_t off, std::uint32_t* line) noexcept
+        {
+            for (unsigned g = 0; g < count; ++g, line += 8)
+            {
+                const unsigned b      = groups[g].byte;
+                const unsigned window = row[b] << 8 | (b < 7 ? row[b + 1] : 0);
+                const Pixels   lit    = (Pixels)((groups[g].masks & window) != 0);
+                const Pixels   pixels = off ^ (lit & (on ^ off));
+                std::memcpy(line, &pixels, sizeof pixels);
+            }
+        }
+#else
+        struct Group
+        {
+            std::uint32_t masks[8];
+            unsigned      byte;
+        };
+
+        void expand_line(const unsigned char* row, const Group* groups, unsigned count,
+                std::uint32_t on, std::uint32_t off, std::uint32_t* line) noexcept
+        {
+            for (unsigned g = 0; g < count; ++g)
+            {
+                const unsigned b      = groups[g].byte;
+                const unsigned window = row[b] << 8 | (b < 7 ? row[b + 1] : 0);
+                for (unsigned k = 0; k < 8; ++k)
+                    *line++ = groups[g].masks[k] & window ? on : off;
+            }
+        }
+#endif
+    }
+
+    void blit_display(const unsigned char* display, unsigned first_row, unsigned rows, unsigned scale,
+                      std::uint32_t* pixels, std::size_t pitch, std::uint32_t on, std::uint32_t off) noexcept
+    {
+        scale = std::min(std::max(scale, 1u), max_blit_scale);
+
+        Group groups[8 * max_blit_scale];
+        const unsigned count = 8 * scale;
+        for (unsigned g = 0; g < count; ++g)
+        {
+            groups[g].byte = 8 * g / scale / 8;
+            for (unsigned k = 0; k < 8; ++k)
+                groups[g].masks[k] = 0x8000 >> ((8 * g + k) / scale - 8 * groups[g].byte);
+        }
+
+        for (unsigned r = first_row; r < first_row + rows; ++r, pixels += pitch * scale)
+        {
+            expand_line(display + r % 32 * 8, groups, count, on, off, pixels);
+            for (unsigned i = 1; i < scale; ++i)
+                std::memcpy(pixels + i * pitch, pixels, 64 * scale * sizeof *pixels);
+        }
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef CHIP8_BLIT_HPP
+#define CHIP8_BLIT_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace chip8
+{
+    constexpr unsigned max_blit_scale = 32;
+
+    /*
+     * Expands `rows` rows of the 1-bit display starting at `first_row` into 32-bit pixels, every
+     * CHIP-8 pixel becoming a `scale` x `scale` square of `on` or `off` (scale up to max_blit_scale).
+     * The output starts at the top-left of `first_row` and its lines are `pitch` pixels apart.
+     * Eight pixels are expanded at a time with AVX2 or SSE2, picked at run time on x86-64 Linux.
+     */
+    void blit_display(const unsigned char* display, unsigned first_row, unsigned rows, unsigned scale,
+                      std::uint32_t* pixels, std::size_t pitch,
+                      std::uint32_t on = 0xFFFFFFFF, std::uint32_t off = 0) noexcept;
+}
+
+#endif
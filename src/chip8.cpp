@@ -0,0 +1,618 @@
+#include "chip8.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace chip8
+{
+    std::uint64_t next_generation() noexcept
+    {
+        static std::atomic<std::uint64_t> generations{0};
+        return ++generations;
+    }
+
+    void Interpreter::copy_font(const Font& font) noexcept
+    {
+        unsigned char* fp = interp_data.font;
+        for (int i = 0; i < 16 * 5; ++i)
+            fp[i] = (font[i / 5] >> (16 - (i % 5) * 4) & 0xF) << 4;
+    }
+
+    void Interpreter::copy_rom(const unsigned char* rom, unsigned size, unsigned loc) noexcept
+    {
+        std::copy_n(rom, size, mem + loc);
+        for (unsigned addr = loc; addr < loc + size; addr += 2)
+            invalidate(addr);
+        if (size)
+            invalidate(loc + size - 1);
+        interp_data.PC = loc;
+    }
+
+    void Interpreter::blank_memory() noexcept
+    {
+        std::fill_n(mem, sizeof mem, 0);
+        std::fill_n(decoded, sizeof decoded / sizeof *decoded, DecodedOp{});
+        tick_phase   = 0;
+        clock        = 0;
+        rng          = 0;
+        written_lo   = 0;
+        written_hi   = 0xFFF;
+        changed_rows = ~0u;
+        touch_all_pages();
+    }
+
+    Interpreter& Interpreter::operator=(const Interpreter& other) noexcept
+    {
+        copy_machine(other);
+        std::copy_n(other.decoded, sizeof decoded / sizeof *decoded, decoded);
+        return *this;
+    }
+
+    void Interpreter::copy_machine(const Interpreter& other) noexcept
+    {
+        std::copy_n(other.mem, sizeof mem, mem);
+        cycles_per_tick = other.cycles_per_tick;
+        tick_phase      = other.tick_phase;
+        clock           = other.clock;
+        rng             = other.rng;
+        written_lo      = 0;
+        written_hi      = 0xFFF;
+        changed_rows    = ~0u;
+        fork_origin     = nullptr;
+        generation      = Generation{};
+        touch_all_pages();
+    }
+
+    Interpreter Interpreter::fork() const noexcept
+    {
+        // the child's decoded ops start out blank and fill in as it runs, rather than copying 8 KB of them
+        Interpreter child;
+        child.copy_machine(*this);
+        child.remember_origin(*this);
+        return child;
+    }
+
+    void Interpreter::remember_origin(const Interpreter& origin) noexcept
+    {
+        fork_origin            = &origin;
+        fork_origin_generation = origin.generation.value;
+        std::copy_n(page_writes,        16, fork_own_writes);
+        std::copy_n(origin.page_writes, 16, fork_origin_writes);
+    }
+
+    void Interpreter::fork_from(const Interpreter& origin) noexcept
+    {
+        if (&origin == this)
+            return;
+        if (fork_origin != &origin || fork_origin_generation != origin.generation.value)
+        {
+            *this = origin;
+        }
+        else
+        {
+            std::copy_n(origin.mem, 0x200, mem);
+            for (unsigned page = 0; page < 16; ++page)
+            {
+                if (page_writes[page] == fork_own_writes[page] && origin.page_writes[page] == fork_origin_writes[page])
+                    continue;
+                if (page >= 2)
+                    std::copy_n(origin.mem + page * 256, 256, mem + page * 256);
+                std::copy_n(origin.decoded + page * 128, 128, decoded + page * 128);
+                ++page_writes[page];
+                written_lo = std::min(written_lo, page * 256);
+                written_hi = std::max(written_hi, page * 256 + 255);
+            }
+            cycles_per_tick = origin.cycles_per_tick;
+            tick_phase      = origin.tick_phase;
+            clock           = origin.clock;
+            rng             = origin.rng;
+            changed_rows    = ~0u;
+        }
+        remember_origin(origin);
+    }
+
+    void Interpreter::save_state(unsigned char* state) const noexcept
+    {
+        const StateHeader header{{'C', '8', 'S', 'T'}, state_version, 0x0102, cycles_per_tick, sizeof mem,
+                                 clock, rng, tick_phase, 0};
+        std::memcpy(state, &header, sizeof header);
+        std::memcpy(state + sizeof header, mem, sizeof mem);
+    }
+
+    bool Interpreter::load_state(const unsigned char* state, std::size_t size) noexcept
+    {
+        StateHeader header;
+        if (size < state_size)
+            return false;
+        std::memcpy(&header, state, sizeof header);
+        if (std::memcmp(header.magic, "C8ST", 4) || header.version != state_version ||
+                header.byte_order != 0x0102 || header.size != sizeof mem || !header.cycles_per_tick)
+            return false;
+
+        std::memcpy(mem, state + sizeof header, sizeof mem);
+        std::fill_n(decoded, sizeof decoded / sizeof *decoded, DecodedOp{});
+        cycles_per_tick = header.cycles_per_tick;
+        tick_phase      = header.tick_phase;
+        clock           = header.clock;
+        rng             = header.rng;
+        written_lo      = 0;
+        written_hi      = 0xFFF;
+        changed_rows    = ~0u;
+        generation      = Generation{};
+        touch_all_pages();
+        return true;
+    }
+
+    std::uint64_t Interpreter::display_hash() const noexcept
+    {
+        std::uint64_t hash = 0xCBF29CE484222325;
+        for (unsigned char byte : interp_data.display)
+            hash = (hash ^ byte) * 0x100000001B3;
+        return hash;
+    }
+
+    Registers Interpreter::registers() const noexcept
+    {
+        Registers registers;
+        std::copy_n(interp_data.Vs, 16, registers.Vs.begin());
+        registers.PC          = interp_data.PC;
+        registers.I           = interp_data.I;
+        registers.SP          = interp_data.SP;
+        registers.delay_timer = interp_data.delay_timer;
+        registers.sound_timer = interp_data.sound_timer;
+        return registers;
+    }
+
+    void Interpreter::clear_display() noexcept
+    {
+        std::fill_n(interp_data.display, sizeof interp_data.display, 0);
+        changed_rows = ~0u;
+    }
+
+    void Interpreter::draw_sprite(unsigned x, unsigned y, unsigned n) noexcept
+    {
+        const std::uint64_t collision = xor_sprite(interp_data.display, mem, interp_data.I, n,
+                interp_data.Vs[x], interp_data.Vs[y], changed_rows);
+        interp_data.Vs[0xF] = collision != 0;
+    }
+
+    void Interpreter::store_bcd(unsigned x) noexcept
+    {
+        mem[(interp_data.I + 2) & 0xFFF] = interp_data.Vs[x]       % 10;
+        mem[(interp_data.I + 1) & 0xFFF] = interp_data.Vs[x] /  10 % 10;
+        mem[ interp_data.I      & 0xFFF] = interp_data.Vs[x] / 100 % 10;
+        invalidate(interp_data.I    );
+        invalidate(interp_data.I + 2);
+    }
+
+    void Interpreter::store_registers(unsigned x) noexcept
+    {
+        //std::copy_n(interp_data.Vs, x + 1, mem + interp_data.I);
+        for (unsigned i = 0; i <= x; ++i)
+        {
+            invalidate(interp_data.I);
+            mem[interp_data.I++ & 0xFFF] = interp_data.Vs[i];
+        }
+    }
+
+    void Interpreter::load_registers(unsigned x) noexcept
+    {
+        //std::copy_n(mem + interp_data.I, x + 1, interp_data.Vs);
+        for (unsigned i = 0; i <= x; ++i)
+            interp_data.Vs[i] = mem[interp_data.I++ & 0xFFF];
+    }
+
+    void Interpreter::execute_instruction() noexcept
+    {
+        // addresses wrap at 4K as in xor_sprite and invalidate, a runaway PC or I stays in memory
+        const unsigned opcode = mem[interp_data.PC & 0xFFF] << 8 | mem[(interp_data.PC + 1) & 0xFFF];
+        interp_data.PC += 2;
+
+        const unsigned nnn = opcode & 0xFFF;
+        const unsigned n   = opcode & 0xF;
+        const unsigned kk  = opcode & 0xFF;
+        
+        const unsigned x = opcode >> 8  & 0xF;
+        const unsigned y = opcode >> 4  & 0xF;
+        const unsigned u = opcode >> 12 & 0xF;
+
+        switch (u)
+        {
+            case 0x0:
+            {
+                switch (nnn)
+                {
+                    case 0x0E0: // CLS - clear the display
+                        clear_display();
+                        break;
+                    case 0x0EE: // RET - return from subroutine
+                        interp_data.PC = interp_data.stack[interp_data.SP--];
+                        break;
+                }
+                break;
+            }
+            case 0x1: // JP addr - jump to location nnn
+                interp_data.PC = nnn;
+                break;
+            case 0x2: // CALL addr - call subroutine at nnn
+                push_return();
+                interp_data.PC = nnn;
+                break;
+            case 0x3: // SE Vx, byte - skip next instruction if Vx = kk
+                if (interp_data.Vs[x] == kk)
+                    interp_data.PC += 2;
+                break;
+            case 0x4: // SNE Vx, byte - skip next instruction if Vx != kk
+                if (interp_data.Vs[x] != kk)
+                    interp_data.PC += 2;
+                break;
+            case 0x5: // SE Vx, Vy - skip next instruction if Vx = Vy 
+                if (!n)
+                    if (interp_data.Vs[x] == interp_data.Vs[y])
+                        interp_data.PC += 2;
+                break;
+            case 0x6: // LD Vx, byte - set Vx = kk
+                interp_data.Vs[x] = kk;
+                break;
+            case 0x7: // ADD Vx, byte - set Vx = Vx + kk
+                interp_data.Vs[x] += kk;
+                break;
+            case 0x8:
+            {
+                switch (n)
+                {
+                    case 0x0: // LD Vx, Vy - set Vx = Vy
+                        interp_data.Vs[x]  = interp_data.Vs[y];
+                        break;
+                    case 0x1: // OR Vx, Vy - set Vx = Vx OR Vy
+                        interp_data.Vs[x] |= interp_data.Vs[y];
+                        break;
+                    case 0x2: // AND Vx, Vy - set Vx = Vx AND Vy
+                        interp_data.Vs[x] &= interp_data.Vs[y];
+                        break;
+                    case 0x3: // XOR Vx, Vy - set Vx = Vx XOR Vy
+                        interp_data.Vs[x] ^= interp_data.Vs[y];
+                        break;
+                    case 0x4: // ADD Vx, Vy - set Vx = Vx + Vy, set VF = carry
+                    {
+                        const unsigned temp = interp_data.Vs[x] + interp_data.Vs[y];
+                        interp_data.Vs[0xF] = temp >> 8;
+                        interp_data.Vs[  x] = temp;
+                        break;
+                    }
+                    case 0x5: // SUB Vx, Vy - set Vx - Vy, set VF = NOT borrow
+                    {
+                        const unsigned temp = interp_data.Vs[x] - interp_data.Vs[y];
+                        interp_data.Vs[0xF] = !(temp >> 8);
+                        interp_data.Vs[  x] =   temp;
+                        break;
+                    }
+                    case 0x6: // SHR Vx {, Vy} - set Vx = Vy SHR 1
+                    {
+                        interp_data.Vs[0xF] = interp_data.Vs[x] & 1; //
+                        interp_data.Vs[  x] >>= 1;                   // On the original interpreter, the value of
+                        break;                                       //
+                    }                                                // Vy is shifted. On current implementations,
+                    case 0xE: // SHL Vx {, Vy} - set Vx = Vy SHL 1   //
+                    {                                                // Y is ignored.
+                        interp_data.Vs[0xF] = interp_data.Vs[x] >> 7;//
+                        interp_data.Vs[  x] <<= 1;     /*https://en.wikipedia.org/wiki/CHIP-8#cite_note-shift-2*/
+                        break;                                       
+                    }
+                    case 0x7: // SUBN Vx, Vy - set Vx = Vy - Vx, set VF = NOT borrow
+                    {
+                        const unsigned temp = interp_data.Vs[y] - interp_data.Vs[x];
+                        interp_data.Vs[0xF] = !(temp >> 8);
+                        interp_data.Vs[  x] =   temp; 
+                        break;
+                    }
+                }
+                break;
+            }
+            case 0x9:
+                if (!n) // SNE Vx, Vy - skip next instruction if Vx != Vy 
+                    if (interp_data.Vs[x] != interp_data.Vs[y])
+                        interp_data.PC += 2;
+                break;
+            case 0xA: // LD I, addr - set I = nnn
+                interp_data.I = nnn;
+                break;
+            case 0xB: // JP V0, addr - jump to location nnn + V0
+                interp_data.PC = nnn + *interp_data.Vs;
+                break;
+            case 0xC: // RND Vx, byte - set Vx = random byte AND kk
+                interp_data.Vs[x] = random_byte() & kk;
+                break;
+            case 0xD: // DRW Vx, Vy nibble - display n-byte sprite starting at memory location I
+                      // at (Vx, Vy), set VF = collision
+                draw_sprite(x, y, n);
+                break;
+            case 0xE:
+            {
+                switch (kk)
+                {
+                    case 0x9E: // SKP Vx - skip next instruction if key with the value pf Vx is pressed
+                        if (interp_data.keys[interp_data.Vs[x]])
+                            interp_data.PC += 2;
+                        break;
+                    case 0xA1: // SKNP Vx - skip next instruction if key with the value of Vx is not pressed
+                        if (!interp_data.keys[interp_data.Vs[x]])
+                            interp_data.PC += 2;
+                        break;
+                }
+                break;
+            }
+            case 0xF:
+            {
+                switch (kk)
+                {
+                    case 0x07: // LD Vx, DT - set Vx = dispaly timer value
+                        interp_data.Vs[x] = interp_data.delay_timer;
+                        break;
+                    case 0x0A: // LD Vx, K - wait for a key press, store the value of the key in Vx
+                        interp_data.wait_key = x;
+                        break;
+                    case 0x15: // LD DT, Vx - set delay timer = Vx
+                        interp_data.delay_timer = interp_data.Vs[x];
+                        break;
+                    case 0x18: // LD ST, Vx - set sound timer = Vx
+                        interp_data.sound_timer = interp_data.Vs[x];
+                        break;
+                    case 0x1E: // ADD I, Vx - set I = I + Vx
+                    {
+                        const unsigned  temp = interp_data.I + interp_data.Vs[x];
+                        interp_data.Vs[0xF] = temp >> 12;
+                        interp_data.I = temp;
+                        // VF is set to 1 when there is a range overflow (I+VX>0xFFF), and to 0 when there isn't.
+                        // This is an undocumented feature of the CHIP-8
+                        //
+                        // https://en.wikipedia.org/wiki/CHIP-8#cite_note-onlgame-3
+                        break;
+                    }
+                    case 0x29: // LD F, Vx - set I = location of sprite for digit Vx
+                        interp_data.I = interp_data.Vs[x] * 5;
+                        break;
+                    case 0x33: // LD B, Vx - store BCD representation of Vx in memory locations I, I + 1, and I + 2
+                        store_bcd(x);
+                        break;
+                /**/case 0x55: // LD [I], Vx - store registers V0 through Vx in memory starting at location I
+                /**/    store_registers(x);
+                /**/    break;
+                /**/case 0x65: // LD Vx, [I] - read registers V0 through Vx from memory starting at location I
+                /**/    load_registers(x);
+                /**/    break;
+                /** On the original interpreter, when the operation is done, I=I+X+1.*/
+                /** On current implementations, I is left unchanged.
+                 ** 
+                 ** https://en.wikipedia.org/wiki/CHIP-8#cite_note-memi-4
+                 **
+                 ** Old version is needed for same programs though.
+                 **
+                 **/
+                }
+                break;
+            }
+        }
+    }
+
+    void Interpreter::elapse(std::uint64_t cycles) noexcept
+    {
+        // a tick fires at the start of every slot that finds `cycles_per_tick` slots behind it;
+        // the slots are idle or went to ops that do not touch the timers
+        const std::uint64_t slots = tick_phase + cycles;
+        const std::uint64_t ticks = (slots - 1) / cycles_per_tick;
+
+        interp_data.delay_timer -= std::min<std::uint64_t>(interp_data.delay_timer, ticks);
+        interp_data.sound_timer -= std::min<std::uint64_t>(interp_data.sound_timer, ticks);
+        tick_phase               = slots - ticks * cycles_per_tick;
+    }
+
+    namespace
+    {
+#define CHIP8_HANDLERS(X)                                                                           \
+        X(undecoded) X(nop)      X(cls)      X(ret)      X(jp)       X(call)     X(se_byte)         \
+        X(sne_byte)  X(se_reg)   X(ld_byte)  X(add_byte) X(ld_reg)   X(or_reg)   X(and_reg)         \
+        X(xor_reg)   X(add_reg)  X(sub_reg)  X(shr)      X(subn_reg) X(shl)      X(sne_reg)         \
+        X(ld_i)      X(jp_v0)    X(rnd)      X(drw)      X(skp)      X(sknp)     X(ld_vx_dt)        \
+        X(ld_vx_k)   X(ld_dt_vx) X(ld_st_vx) X(add_i_vx) X(ld_f_vx)  X(ld_b_vx)  X(ld_mem_vx)       \
+        X(ld_vx_mem)
+
+#define CHIP8_HANDLER_ENUMERATOR(name) name,
+
+        enum Handler : std::uint8_t {CHIP8_HANDLERS(CHIP8_HANDLER_ENUMERATOR)};
+
+#undef CHIP8_HANDLER_ENUMERATOR
+
+        Handler decode_handler(unsigned opcode) noexcept
+        {
+            const unsigned n  = opcode & 0xF;
+            const unsigned kk = opcode & 0xFF;
+            switch (opcode >> 12)
+            {
+                case 0x0: return opcode == 0x00E0 ? cls : opcode == 0x00EE ? ret : nop;
+                case 0x1: return jp;
+                case 0x2: return call;
+                case 0x3: return se_byte;
+                case 0x4: return sne_byte;
+                case 0x5: return n ? nop : se_reg;
+                case 0x6: return ld_byte;
+                case 0x7: return add_byte;
+                case 0x8:
+                {
+                    static constexpr Handler alu[16]
+                    {
+                        ld_reg, or_reg, and_reg, xor_reg, add_reg, sub_reg, shr, subn_reg,
+                        nop,    nop,    nop,     nop,     nop,     nop,     shl, nop
+                    };
+                    return alu[n];
+                }
+                case 0x9: return n ? nop : sne_reg;
+                case 0xA: return ld_i;
+                case 0xB: return jp_v0;
+                case 0xC: return rnd;
+                case 0xD: return drw;
+                case 0xE: return kk == 0x9E ? skp : kk == 0xA1 ? sknp : nop;
+                default:
+                {
+                    switch (kk)
+                    {
+                        case 0x07: return ld_vx_dt;
+                        case 0x0A: return ld_vx_k;
+                        case 0x15: return ld_dt_vx;
+                        case 0x18: return ld_st_vx;
+                        case 0x1E: return add_i_vx;
+                        case 0x29: return ld_f_vx;
+                        case 0x33: return ld_b_vx;
+                        case 0x55: return ld_mem_vx;
+                        case 0x65: return ld_vx_mem;
+                        default:   return nop;
+                    }
+                }
+            }
+        }
+    }
+
+#if defined(__GNUC__) && !defined(CHIP8_NO_COMPUTED_GOTO)
+#   define CHIP8_COMPUTED_GOTO
+#   pragma GCC diagnostic push
+#   pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+    /*
+     * Executes ops from the predecoded table. Threaded = true replicates the fetch and an indirect
+     * jump through a label table at the end of every handler (GCC labels-as-values); otherwise, or
+     * without compiler support, every handler returns to one central switch.
+     */
+    template<bool Threaded>
+    void Interpreter::run_decoded(std::uint64_t cycles) noexcept
+    {
+        clock += cycles;
+        if (interp_data.wait_key)
+        {
+            elapse(cycles);
+            return;
+        }
+
+#ifdef CHIP8_COMPUTED_GOTO
+#   define CHIP8_HANDLER_LABEL_ADDRESS(name) &&name##_op,
+        static const void* const labels[] {CHIP8_HANDLERS(CHIP8_HANDLER_LABEL_ADDRESS)};
+#   undef CHIP8_HANDLER_LABEL_ADDRESS
+#   define CHIP8_DISPATCH() do {if (Threaded) goto *labels[op.handler]; else goto central_switch;} while (0)
+#else
+#   define CHIP8_DISPATCH() goto central_switch
+#endif
+
+#define CHIP8_NEXT()                                                                                \
+        do                                                                                          \
+        {                                                                                           \
+            if (!left) goto done;                                                                   \
+            --left;                                                                                 \
+            if (phase >= cycles_per_tick) {update_timers(); phase = 0;}                             \
+            ++phase;                                                                                \
+            pc = interp_data.PC;                                                                    \
+            if (pc & 1 || pc - 0x200 > 0xFFE - 0x200) goto uncached;                                \
+            op = decoded[pc >> 1];                                                                  \
+            if (op.handler == undecoded) goto decode;                                               \
+            interp_data.PC = pc + 2;                                                                \
+            CHIP8_DISPATCH();                                                                       \
+        }                                                                                           \
+        while (0)
+
+        unsigned char* const Vs = interp_data.Vs;
+        std::uint64_t left  = cycles;
+        unsigned      phase = tick_phase;
+        unsigned      pc, temp;
+        DecodedOp     op;
+
+        CHIP8_NEXT();
+
+    central_switch:
+        switch (op.handler)
+        {
+#define CHIP8_HANDLER_CASE(name) case name: goto name##_op;
+            CHIP8_HANDLERS(CHIP8_HANDLER_CASE)
+#undef CHIP8_HANDLER_CASE
+        }
+
+    uncached: // the interpreter area changes behind the cache's back, odd addresses have no slot
+        execute_instruction();
+        if (interp_data.wait_key) goto done;
+        CHIP8_NEXT();
+
+    decode:
+        temp = mem[pc] << 8 | mem[pc + 1];
+        op   = decoded[pc >> 1] = {decode_handler(temp),
+                                   static_cast<std::uint8_t>(temp >> 8 & 0xF),
+                                   static_cast<std::uint8_t>(temp >> 4 & 0xF),
+                                   static_cast<std::uint8_t>(temp      & 0xFF)};
+        interp_data.PC = pc + 2;
+        CHIP8_DISPATCH();
+
+    undecoded_op:
+    nop_op:         CHIP8_NEXT();
+    cls_op:         clear_display();                                                        CHIP8_NEXT();
+    ret_op:         interp_data.PC = interp_data.stack[interp_data.SP--];                   CHIP8_NEXT();
+    jp_op:          interp_data.PC = op.x << 8 | op.kk;                                     CHIP8_NEXT();
+    call_op:        push_return();
+                    interp_data.PC = op.x << 8 | op.kk;                                     CHIP8_NEXT();
+    se_byte_op:     if (Vs[op.x] == op.kk)    interp_data.PC += 2;                          CHIP8_NEXT();
+    sne_byte_op:    if (Vs[op.x] != op.kk)    interp_data.PC += 2;                          CHIP8_NEXT();
+    se_reg_op:      if (Vs[op.x] == Vs[op.y]) interp_data.PC += 2;                          CHIP8_NEXT();
+    sne_reg_op:     if (Vs[op.x] != Vs[op.y]) interp_data.PC += 2;                          CHIP8_NEXT();
+    ld_byte_op:     Vs[op.x]  = op.kk;                                                      CHIP8_NEXT();
+    add_byte_op:    Vs[op.x] += op.kk;                                                      CHIP8_NEXT();
+    ld_reg_op:      Vs[op.x]  = Vs[op.y];                                                   CHIP8_NEXT();
+    or_reg_op:      Vs[op.x] |= Vs[op.y];                                                   CHIP8_NEXT();
+    and_reg_op:     Vs[op.x] &= Vs[op.y];                                                   CHIP8_NEXT();
+    xor_reg_op:     Vs[op.x] ^= Vs[op.y];                                                   CHIP8_NEXT();
+    add_reg_op:     temp = Vs[op.x] + Vs[op.y]; Vs[0xF] =   temp >> 8;  Vs[op.x] = temp;    CHIP8_NEXT();
+    sub_reg_op:     temp = Vs[op.x] - Vs[op.y]; Vs[0xF] = !(temp >> 8); Vs[op.x] = temp;    CHIP8_NEXT();
+    subn_reg_op:    temp = Vs[op.y] - Vs[op.x]; Vs[0xF] = !(temp >> 8); Vs[op.x] = temp;    CHIP8_NEXT();
+    shr_op:         Vs[0xF] = Vs[op.x] & 1;  Vs[op.x] >>= 1;                                CHIP8_NEXT();
+    shl_op:         Vs[0xF] = Vs[op.x] >> 7; Vs[op.x] <<= 1;                                CHIP8_NEXT();
+    ld_i_op:        interp_data.I  = op.x << 8 | op.kk;                                     CHIP8_NEXT();
+    jp_v0_op:       interp_data.PC = (op.x << 8 | op.kk) + *Vs;                             CHIP8_NEXT();
+    rnd_op:         Vs[op.x] = random_byte() & op.kk;                                       CHIP8_NEXT();
+    drw_op:         draw_sprite(op.x, op.y, op.kk & 0xF);                                   CHIP8_NEXT();
+    skp_op:         if ( interp_data.keys[Vs[op.x]]) interp_data.PC += 2;                   CHIP8_NEXT();
+    sknp_op:        if (!interp_data.keys[Vs[op.x]]) interp_data.PC += 2;                   CHIP8_NEXT();
+    ld_vx_dt_op:    Vs[op.x] = interp_data.delay_timer;                                     CHIP8_NEXT();
+    ld_vx_k_op:     interp_data.wait_key = op.x;
+                    if (interp_data.wait_key)
+                        goto done;
+                    CHIP8_NEXT();
+    ld_dt_vx_op:    interp_data.delay_timer = Vs[op.x];                                     CHIP8_NEXT();
+    ld_st_vx_op:    interp_data.sound_timer = Vs[op.x];                                     CHIP8_NEXT();
+    add_i_vx_op:    temp = interp_data.I + Vs[op.x]; Vs[0xF] = temp >> 12; interp_data.I = temp;
+                                                                                            CHIP8_NEXT();
+    ld_f_vx_op:     interp_data.I = Vs[op.x] * 5;                                           CHIP8_NEXT();
+    ld_b_vx_op:     store_bcd(op.x);                                                        CHIP8_NEXT();
+    ld_mem_vx_op:   store_registers(op.x);                                                  CHIP8_NEXT();
+    ld_vx_mem_op:   load_registers(op.x);                                                   CHIP8_NEXT();
+
+    done:
+        tick_phase = phase;
+        if (interp_data.wait_key && left) // a key wait idles the rest of the slots
+            elapse(left);
+
+#undef CHIP8_NEXT
+#undef CHIP8_DISPATCH
+    }
+
+#ifdef CHIP8_COMPUTED_GOTO
+#   pragma GCC diagnostic pop
+#endif
+
+#undef CHIP8_HANDLERS
+
+    template<>
+    void Interpreter::run<Dispatch::switch_table>(std::uint64_t cycles) noexcept
+    {
+        NullObserver observer;
+        run_observed(cycles, observer);
+    }
+
+    template<> void Interpreter::run<Dispatch::predecoded>(std::uint64_t cycles) noexcept {run_decoded<false>(cycles);}
+    template<> void Interpreter::run<Dispatch::threaded  >(std::uint64_t cycles) noexcept {run_decoded<true >(cycles);}
+}
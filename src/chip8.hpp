@@ -0,0 +1,430 @@
+#ifndef CHIP8_HPP
+#define CHIP8_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace chip8
+{
+    using Font = std::array<unsigned, 16>;
+    namespace fonts
+    {
+        constexpr Font original_chip8
+        {
+            {
+                0xF999F, 0x26227, 0xF1F8F, 0xF1F1F, 0x99F11, 0xF8F1F, 0xF8F9F, 0xF1244,
+                0xF9F9F, 0xF9F1F, 0xF9F99, 0xE9E9E, 0xF888F, 0xE999E, 0xF8F8F, 0xF8F88
+            }
+        };
+    }
+
+    enum class Dispatch
+    {
+        switch_table,   // decode every opcode through the nested switch of execute_instruction
+        predecoded,     // execute cached decoded ops through one central switch
+        threaded,       // execute cached decoded ops with direct-threaded dispatch (computed goto)
+        jit             // execute basic blocks recompiled to x86-64 (threaded elsewhere)
+    };
+
+    /*
+     * PCG-XSH-RR: a 64-bit LCG state with a permuted 32-bit output. Every state, zero included,
+     * is a valid one, so a blank machine has a reproducible sequence before it is seeded.
+     */
+    inline std::uint32_t pcg32(std::uint64_t& state) noexcept
+    {
+        const std::uint64_t old = state;
+        state = old * 6364136223846793005 + 1442695040888963407;
+        const std::uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+        const std::uint32_t rot        = old >> 59;
+        return xorshifted >> rot | xorshifted << (-rot & 31);
+    }
+
+    inline std::uint64_t pcg32_seed(std::uint64_t seed) noexcept
+    {
+        std::uint64_t state = 0;
+        pcg32(state);
+        state += seed;
+        pcg32(state);
+        return state;
+    }
+
+    // a display row as a word with the leftmost pixel in bit 63
+    inline std::uint64_t load_row(const unsigned char* p) noexcept
+    {
+        std::uint64_t row;
+        std::memcpy(&row, p, sizeof row);
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        row = __builtin_bswap64(row);
+#elif !defined(__GNUC__)
+        row = 0;
+        for (int k = 0; k < 8; ++k)
+            row = row << 8 | p[k];
+#endif
+        return row;
+    }
+
+    inline void store_row(unsigned char* p, std::uint64_t row) noexcept
+    {
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        row = __builtin_bswap64(row);
+        std::memcpy(p, &row, sizeof row);
+#elif defined(__GNUC__)
+        std::memcpy(p, &row, sizeof row);
+#else
+        for (int k = 0; k < 8; ++k)
+            p[k] = row >> (56 - 8 * k);
+#endif
+    }
+
+    /*
+     * XORs the n-byte sprite at `memory + I` onto the 1-bit display at (px, py), wrapping at the
+     * edges, and returns a non-zero word if a lit pixel was erased. Each display row is taken as
+     * one big-endian 64-bit word, leftmost pixel in bit 63, and each sprite byte is rotated into
+     * place, so a row costs a load, a rotate, an XOR and an AND. Rows that got a non-empty sprite
+     * byte are added to `rows`.
+     */
+    inline std::uint64_t xor_sprite(unsigned char* display, const unsigned char* memory,
+                                    unsigned I, unsigned n, unsigned px, unsigned py, std::uint32_t& rows) noexcept
+    {
+        const unsigned shift = px % 64;
+        std::uint64_t collision = 0;
+        for (unsigned i = 0; i < n; ++i)
+        {
+            const std::uint64_t byte = memory[(I + i) & 0xFFF];
+            if (!byte)
+                continue;
+            unsigned char* const p = display + (py + i) % 32 * 8;
+
+            const std::uint64_t row    = load_row(p);
+            const std::uint64_t sprite = byte << 56 >> shift | byte << 56 << (-shift & 63);
+            collision |= row & sprite;
+            store_row(p, row ^ sprite);
+
+            rows |= 1u << (py + i) % 32;
+        }
+        return collision;
+    }
+
+    struct Registers
+    {
+        std::array<unsigned char, 16> Vs;
+        unsigned short PC, I;
+        unsigned char  SP, delay_timer, sound_timer;
+    };
+
+    /*
+     * Header of a saved machine state, followed by the 4096-byte memory image. The header and
+     * the interpreter area of the image hold native-endian fields, so states load only on hosts
+     * of the same byte order; `byte_order` is 0x0102 as written by the saving host.
+     */
+    struct StateHeader
+    {
+        char          magic[4];         // "C8ST"
+        std::uint16_t version;
+        std::uint16_t byte_order;
+        std::uint32_t cycles_per_tick;
+        std::uint32_t size;             // bytes of the memory image
+        std::uint64_t clock;
+        std::uint64_t rng;
+        std::uint32_t tick_phase;
+        std::uint32_t reserved;         // 0, keeps the header free of padding
+    };
+
+    static_assert(sizeof(StateHeader) == 40, "a saved state header has no padding");
+
+    // the observer of a plain run, its hooks compile away
+    struct NullObserver
+    {
+        void execute(unsigned /*pc*/, unsigned /*opcode*/) noexcept {}
+        void wait(std::uint64_t /*slots*/) noexcept {}
+    };
+
+    class JitCache;
+    class Lockstep;
+
+    void destroy_jit_cache(JitCache* cache) noexcept;
+
+    // a number no other machine state has had, from any thread
+    std::uint64_t next_generation() noexcept;
+
+    /*
+     * Names the contents of one machine: stamped anew on construction, on every copy or move
+     * into a machine and on load_state, so an address alone never vouches for the contents.
+     */
+    struct Generation
+    {
+        std::uint64_t value = next_generation();
+
+        Generation() = default;
+        Generation(const Generation&) noexcept {}
+        Generation& operator=(const Generation&) noexcept {value = next_generation(); return *this;}
+    };
+
+    class Interpreter
+    {
+        friend class JitCache;
+        friend class Lockstep;
+
+        union
+        {
+            unsigned char mem[4096]{};
+            struct
+            {
+                unsigned char font[16 * 5], display[64 * 32 / 8], Vs[16], keys[16];
+                unsigned char delay_timer, sound_timer, SP, wait_key;
+                unsigned short stack[16], PC, I;
+            } interp_data;
+        };
+
+        static_assert(sizeof interp_data <= 0x200, "interpreter data overlaps the program area");
+
+        /*
+         * Emulator bookkeeping lives outside `mem`: a stack overflowing past stack[15] runs into
+         * PC, I and the rest of the interpreter area, but never into the clock or the generator.
+         */
+        std::uint32_t tick_phase = 0;   // instruction slots since the last timer tick
+        std::uint64_t clock      = 0;   // instruction slots elapsed on the virtual clock
+        std::uint64_t rng        = 0;   // CXNN generator state, see pcg32
+
+        /*
+         * A decoded form of the opcode at every even address: a handler index and its operands.
+         * A zero handler marks a slot to be decoded on the next fetch; writes into memory
+         * (FX33, FX55, copy_rom, blank_memory) clear the slots they cover.
+         */
+        struct DecodedOp
+        {
+            std::uint8_t handler, x, y, kk; // nnn = x << 8 | kk, n = kk & 0xF
+        };
+
+        DecodedOp decoded[4096 / 2]{};
+
+        unsigned cycles_per_tick = 10;
+
+        // the range of code memory written since the JIT cache last dropped its stale blocks
+        unsigned written_lo = 0xFFFF, written_hi = 0;
+
+        std::unique_ptr<JitCache, void(*)(JitCache*)> jit_cache{nullptr, destroy_jit_cache};
+
+        /*
+         * Writes through `invalidate` per 256-byte page, and both sides' counts when this machine
+         * was last forked from `fork_origin`: a page whose count moved on either side since then
+         * is the only kind fork_from copies again. The first two pages, holding the registers,
+         * stack and display, are always copied. The origin is known by its address and its
+         * generation, as another machine may take its place at that address.
+         */
+        std::uint32_t page_writes[16]{};
+        std::uint32_t fork_own_writes[16]{}, fork_origin_writes[16]{};
+        const Interpreter* fork_origin = nullptr;
+        std::uint64_t      fork_origin_generation = 0;
+        Generation         generation;
+
+        void touch_all_pages() noexcept
+        {
+            for (std::uint32_t& writes : page_writes)
+                ++writes;
+        }
+
+        void invalidate(unsigned addr) noexcept
+        {
+            addr &= 0xFFF;
+            ++page_writes[addr >> 8];
+            decoded[addr >> 1].handler = 0;
+            if (addr < written_lo) written_lo = addr;
+            if (addr > written_hi) written_hi = addr;
+        }
+
+        // a stack run past 16 levels goes on through PC and I into the program area, which CALL
+        // then writes like any store
+        void invalidate_stack_top() noexcept
+        {
+            const unsigned slot = reinterpret_cast<const unsigned char*>(interp_data.stack + interp_data.SP) - mem;
+            if (slot >= 0x200)
+            {
+                invalidate(slot    );
+                invalidate(slot + 1);
+            }
+        }
+
+        void push_return() noexcept
+        {
+            interp_data.stack[++interp_data.SP] = interp_data.PC;
+            invalidate_stack_top();
+        }
+
+        // display rows changed by DXYN or 00E0 since the frontend last took them, bit n for row n
+        std::uint32_t changed_rows = ~0u;
+
+        void clear_display() noexcept;
+
+        unsigned char random_byte() noexcept {return pcg32(rng) >> 24;}
+
+        void draw_sprite(unsigned x, unsigned y, unsigned n) noexcept;
+        void store_bcd(unsigned x) noexcept;
+        void store_registers(unsigned x) noexcept;
+        void load_registers(unsigned x) noexcept;
+
+        template<bool Threaded> void run_decoded(std::uint64_t cycles) noexcept;
+
+        void elapse(std::uint64_t cycles) noexcept;
+
+        // copies everything but the decoded ops, which stay as they are, and the JIT cache
+        void copy_machine(const Interpreter& other) noexcept;
+
+        // records the page write counts fork_from compares against
+        void remember_origin(const Interpreter& origin) noexcept;
+
+    public:
+        Interpreter() = default;
+
+        // copies the machine state, every instance keeps its own JIT cache
+        Interpreter(const Interpreter& other) noexcept {*this = other;}
+        Interpreter& operator=(const Interpreter& other) noexcept;
+
+        Interpreter(Interpreter&&) noexcept = default;
+        Interpreter& operator=(Interpreter&&) noexcept = default;
+
+        /*
+         * A copy of this machine that fork_from can return to this machine's state later by
+         * copying only the pages written since. The child's JIT cache survives such resets.
+         */
+        Interpreter fork() const noexcept;
+
+        // becomes a copy of `origin`, copying only changed pages if this machine was forked from it
+        void fork_from(const Interpreter& origin) noexcept;
+
+        void copy_font(const Font& font) noexcept;
+        void copy_rom(const unsigned char* rom, unsigned size, unsigned loc = 0x200) noexcept;
+
+        void blank_memory() noexcept;
+
+        void update_timers() noexcept
+        {
+            if (interp_data.delay_timer > 0) --interp_data.delay_timer;
+            if (interp_data.sound_timer > 0) --interp_data.sound_timer;
+        }
+
+        void update_key(int code, bool status) noexcept {interp_data.keys[code] = status;}
+
+        void set_wait_key(int code) noexcept
+        {
+            interp_data.Vs[interp_data.wait_key] = code;
+            interp_data.wait_key = 0;
+        }
+
+        // a key change as a keyboard makes it, a press also ends an FX0A wait
+        void key_event(int code, bool down) noexcept
+        {
+            update_key(code, down);
+            if (down && interp_data.wait_key)
+                set_wait_key(code);
+        }
+
+        void execute_instruction() noexcept;
+
+        /*
+         * Advances the virtual clock by `cycles` instruction slots as fast as the host allows.
+         * The timers tick once every `cycles_per_tick` slots (10 slots give the original
+         * 600 instructions/s against 60 Hz timers); slots spent waiting for a key only
+         * advance the clock.
+         */
+        template<Dispatch D = Dispatch::switch_table>
+        void run(std::uint64_t cycles) noexcept;
+
+        /*
+         * run<Dispatch::switch_table> reporting to `observer`: `execute(pc, opcode)` before
+         * every instruction and `wait(slots)` for slots idled by an FX0A key wait. An observer
+         * with empty hooks costs nothing, run<Dispatch::switch_table> is this with NullObserver.
+         */
+        template<typename Observer>
+        void run_observed(std::uint64_t cycles, Observer& observer)
+        {
+            clock += cycles;
+            while (cycles)
+            {
+                if (interp_data.wait_key)
+                {
+                    observer.wait(cycles);
+                    elapse(cycles);
+                    break;
+                }
+                if (tick_phase >= cycles_per_tick)
+                {
+                    update_timers();
+                    tick_phase = 0;
+                }
+                // the slots up to the next tick, a key wait idles the rest of them
+                const unsigned slice = std::min<std::uint64_t>(cycles, cycles_per_tick - tick_phase);
+                tick_phase += slice;
+                cycles                 -= slice;
+                for (unsigned i = slice; i--;)
+                {
+                    if (interp_data.wait_key)
+                    {
+                        observer.wait(i + 1);
+                        break;
+                    }
+                    const unsigned pc = interp_data.PC & 0xFFF;
+                    observer.execute(pc, mem[pc] << 8 | mem[(pc + 1) & 0xFFF]);
+                    execute_instruction();
+                }
+            }
+        }
+
+        /*
+         * Runs one slot at a time until `pred(interpreter)` holds or `max_cycles` slots
+         * have elapsed, returns the number of slots run.
+         */
+        template<Dispatch D = Dispatch::switch_table, typename Predicate>
+        std::uint64_t run_until(Predicate pred, std::uint64_t max_cycles = UINT64_MAX)
+        {
+            std::uint64_t cycles = 0;
+            for (; cycles < max_cycles && !pred(static_cast<const Interpreter&>(*this)); ++cycles)
+                run<D>(1);
+            return cycles;
+        }
+
+        void set_cycles_per_tick(unsigned cycles) noexcept {cycles_per_tick = cycles ? cycles : 1;}
+
+        static constexpr std::uint16_t state_version = 2;
+        static constexpr std::size_t    state_size    = sizeof(StateHeader) + 4096;
+
+        // writes `state_size` bytes
+        void save_state(unsigned char* state) const noexcept;
+
+        // returns false and leaves the machine untouched if the state is not one of this version
+        bool load_state(const unsigned char* state, std::size_t size) noexcept;
+
+        // restarts the CXNN sequence, the same seed gives the same run on any thread
+        void seed(std::uint64_t value) noexcept {rng = pcg32_seed(value);}
+
+        const unsigned char* display() const noexcept {return interp_data.display;}
+
+        // returns the rows changed since the last call and clears them, all rows after a state copy
+        std::uint32_t take_changed_rows() noexcept
+        {
+            const std::uint32_t rows = changed_rows;
+            changed_rows = 0;
+            return rows;
+        }
+
+        std::uint64_t display_hash() const noexcept; // FNV-1a over the 1-bit display
+
+        Registers registers() const noexcept;
+
+        std::uint64_t cycles() const noexcept {return clock;}
+
+        bool wait()  const noexcept {return interp_data.wait_key;   }
+        bool sound() const noexcept {return interp_data.sound_timer;}
+    };
+
+    template<> void Interpreter::run<Dispatch::switch_table>(std::uint64_t cycles) noexcept;
+    template<> void Interpreter::run<Dispatch::predecoded  >(std::uint64_t cycles) noexcept;
+    template<> void Interpreter::run<Dispatch::threaded    >(std::uint64_t cycles) noexcept;
+    template<> void Interpreter::run<Dispatch::jit         >(std::uint64_t cycles) noexcept;
+}
+
+#endif
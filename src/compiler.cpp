@@ -1,5 +1,4 @@
 #include <unordered_map>
-#include <iterator>
 #include <stdexcept>
 #include <iostream>
 #include <vector>
@@ -7,348 +6,1474 @@
 #include <algorithm>
 #include <fstream>
 #include <sstream>
-#include <functional>
-#include <queue>
-#include <utility>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
 #include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <deque>
+#include <set>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CHIP8_POSIX_FILES
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace chip8
 {
     namespace compiler
     {
-        const std::unordered_map<std::string, std::string> instructions
-        {
-            {"cls",             "00E0"},
-            {"ret",             "00EE"},
-            {"jp NNN",          "1NNN"},
-            {"call NNN",        "2NNN"},
-            {"se vX NN",        "3XNN"},
-            {"sne vX NN",       "4XNN"},
-            {"se vX vY",        "5XY0"},
-            {"ld vX NN",        "6XNN"},
-            {"add vX NN",       "7XNN"},
-            {"ld vX vY",        "8XY0"},
-            {"or vX vY",        "8XY1"},
-            {"and vX vY",       "8XY2"},
-            {"xor vX vY",       "8XY3"},
-            {"add vX vY",       "8XY4"},
-            {"sub vX vY",       "8XY5"},
-            {"shr vX",          "8XY6"},
-            {"subn vX vY",      "8XY7"},
-            {"shl vX",          "8XYE"},
-            {"sne vX vY",       "9XY0"},
-            {"ld I NNN",        "ANNN"},
-            {"jp v0 N",         "BNNN"},
-            {"rnd vX N",        "CXNN"},
-            {"drw vX vY N",     "DXYN"},
-            {"skp vX",          "EX9E"},
-            {"sknp vX",         "EXA1"},
-            {"ld vX DT",        "FX07"},
-            {"ld vX N",         "FX0A"},
-            {"ld DT vX",        "FX15"},
-            {"ld ST vX",        "FX18"},
-            {"add I vX",        "FX1E"},
-            {"ld F vX",         "FX29"},
-            {"ld B vX",         "FX33"},
-            {"ld [I] vX",       "FX55"},
-            {"ld vX [I]",       "FX65"}
+        // a run of source characters; the source outlives every Text over it, so nothing is copied
+        struct Text
+        {
+            const char* first = nullptr;
+            const char* last  = nullptr;
+
+            std::size_t size() const noexcept {return last - first;}
+
+            template<std::size_t N>
+            bool operator==(const char (&str)[N]) const noexcept
+            {
+                return size() == N - 1 && std::equal(first, last, str);
+            }
+
+            template<std::size_t N>
+            bool operator!=(const char (&str)[N]) const noexcept {return !(*this == str);}
+
+            bool is(const char* str) const noexcept
+            {
+                return !std::strncmp(first, str, size()) && !str[size()];
+            }
+
+            friend bool operator==(Text a, Text b) noexcept
+            {
+                return a.size() == b.size() && std::equal(a.first, a.last, b.first);
+            }
+
+            std::string str() const {return {first, last};}
         };
 
-        constexpr bool is_dec_digit(char c) noexcept {return c >= '0' && c <= '9';}
+        // eight bytes a step, chunks of source get hashed whole
+        struct TextHash
+        {
+            std::size_t operator()(Text text) const noexcept
+            {
+                std::uint64_t hash = text.size() * 0x9E3779B97F4A7C15ull, word;
+                const char* c = text.first;
+                for (; text.last - c >= 8; c += 8)
+                {
+                    std::memcpy(&word, c, 8);
+                    hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+                    hash ^= hash >> 32;
+                }
+                for (word = 0; c != text.last; ++c)
+                    word = word << 8 | static_cast<unsigned char>(*c);
+                hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+                return hash ^ hash >> 32;
+            }
+        };
+
+        // what an operand of an instruction form takes, and where it goes in the opcode
+        enum class Operand : unsigned char
+        {
+            vx, vy, vxy, v0,            // a register into bits 8-11, bits 4-7, both of them, or v0 only
+            nnn, nn, n,                 // a constant expression into the low 12, 8 or 4 bits
+            I, DT, ST, F, B, K, I_ref,  // I, DT, ST, F, B, K and [I] as they are
+            byte                        // a whole byte of byte data
+        };
 
-        constexpr bool is_hex_digit(char c) noexcept
+        struct Form
         {
-            return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F');
+            const char*   mnemonic;
+            std::uint16_t opcode;
+            unsigned char count;
+            Operand       operands[3];
+        };
+
+        // the forms of one mnemonic are adjacent
+        constexpr Form forms[]
+        {
+            {"cls",  0x00E0, 0, {}},
+            {"ret",  0x00EE, 0, {}},
+            {"jp",   0x1000, 1, {Operand::nnn}},
+            {"jp",   0xB000, 2, {Operand::v0, Operand::nnn}},
+            {"call", 0x2000, 1, {Operand::nnn}},
+            {"se",   0x3000, 2, {Operand::vx, Operand::nn}},
+            {"se",   0x5000, 2, {Operand::vx, Operand::vy}},
+            {"sne",  0x4000, 2, {Operand::vx, Operand::nn}},
+            {"sne",  0x9000, 2, {Operand::vx, Operand::vy}},
+            {"ld",   0x6000, 2, {Operand::vx, Operand::nn}},
+            {"ld",   0x8000, 2, {Operand::vx, Operand::vy}},
+            {"ld",   0xA000, 2, {Operand::I,  Operand::nnn}},
+            {"ld",   0xF007, 2, {Operand::vx, Operand::DT}},
+            {"ld",   0xF00A, 2, {Operand::vx, Operand::K}},
+            {"ld",   0xF015, 2, {Operand::DT, Operand::vx}},
+            {"ld",   0xF018, 2, {Operand::ST, Operand::vx}},
+            {"ld",   0xF029, 2, {Operand::F,  Operand::vx}},
+            {"ld",   0xF033, 2, {Operand::B,  Operand::vx}},
+            {"ld",   0xF055, 2, {Operand::I_ref, Operand::vx}},
+            {"ld",   0xF065, 2, {Operand::vx, Operand::I_ref}},
+            {"add",  0x7000, 2, {Operand::vx, Operand::nn}},
+            {"add",  0x8004, 2, {Operand::vx, Operand::vy}},
+            {"add",  0xF01E, 2, {Operand::I,  Operand::vx}},
+            {"or",   0x8001, 2, {Operand::vx, Operand::vy}},
+            {"and",  0x8002, 2, {Operand::vx, Operand::vy}},
+            {"xor",  0x8003, 2, {Operand::vx, Operand::vy}},
+            {"sub",  0x8005, 2, {Operand::vx, Operand::vy}},
+            {"shr",  0x8006, 1, {Operand::vxy}},
+            {"shr",  0x8006, 2, {Operand::vx, Operand::vy}},
+            {"subn", 0x8007, 2, {Operand::vx, Operand::vy}},
+            {"shl",  0x800E, 1, {Operand::vxy}},
+            {"shl",  0x800E, 2, {Operand::vx, Operand::vy}},
+            {"rnd",  0xC000, 2, {Operand::vx, Operand::nn}},
+            {"drw",  0xD000, 3, {Operand::vx, Operand::vy, Operand::n}},
+            {"skp",  0xE09E, 1, {Operand::vx}},
+            {"sknp", 0xE0A1, 1, {Operand::vx}}
+        };
+
+        constexpr std::size_t form_count = sizeof forms / sizeof forms[0];
+
+        constexpr std::size_t length(const char* str) noexcept
+        {
+            std::size_t size = 0;
+            while (str[size])
+                ++size;
+            return size;
+        }
+
+        constexpr bool same(const char* a, const char* b) noexcept
+        {
+            for (; *a && *a == *b; ++a, ++b);
+            return *a == *b;
+        }
+
+        constexpr unsigned mnemonic_hash(const char* first, std::size_t size) noexcept
+        {
+            return size < 2 ? 0 : (first[0] + 3 * (first[1] + first[size - 1]) + size) & 63;
         }
 
-        bool is_dec_number(const std::string& str) noexcept
+        // the forms [first, last) of the mnemonic hashing to each slot, built and checked at compile time
+        struct MnemonicTable
         {
-            return std::all_of(str.cbegin(), str.cend(), std::bind(is_dec_digit, std::placeholders::_1));
+            unsigned char first[64], last[64];
+            bool          perfect;
+        };
+
+        constexpr MnemonicTable make_mnemonic_table() noexcept
+        {
+            MnemonicTable table{};
+            table.perfect = true;
+            for (std::size_t i = 0; i < form_count; ++i)
+            {
+                const unsigned slot = mnemonic_hash(forms[i].mnemonic, length(forms[i].mnemonic));
+                if (i && same(forms[i].mnemonic, forms[i - 1].mnemonic))
+                    table.last[slot] = i + 1;
+                else if (table.last[slot]) // taken by another mnemonic, or by this one's forms elsewhere
+                    table.perfect = false;
+                else
+                {
+                    table.first[slot] = i;
+                    table.last [slot] = i + 1;
+                }
+            }
+            return table;
         }
 
-        bool is_hex_number(const std::string& str) noexcept
+        constexpr MnemonicTable mnemonics = make_mnemonic_table();
+        static_assert(mnemonics.perfect, "two mnemonics share a slot of mnemonic_hash, or a mnemonic's forms are apart");
+
+        struct Token
+        {
+            enum Type : unsigned char {end, word, number, string, symbol};
+
+            Type          type;
+            Text          text;         // a string without its quotes
+            std::uint64_t value = 0;    // of a number
+        };
+
+        [[noreturn]] void fail(unsigned line, const std::string& message, const std::string* file = nullptr)
         {
-            return std::all_of(str.cbegin(), str.cend(), std::bind(is_hex_digit, std::placeholders::_1));
+            throw std::runtime_error{"line " + std::to_string(line) + (file ? " of " + *file : std::string{}) + ": " + message};
         }
 
-        std::string to_hex_string(unsigned value)
+        constexpr bool is_dec_digit(char c) noexcept {return c >= '0' && c <= '9';}
+
+        constexpr int hex_digit_value(char c) noexcept
         {
-            std::ostringstream sstream_hex;
-            sstream_hex << std::hex << value;
-            return sstream_hex.str();
+            return c >= '0' && c <= '9' ? c - '0' :
+                   c >= 'A' && c <= 'F' ? c - 'A' + 10 :
+                   c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
         }
 
-        std::vector<std::uint8_t> parse_byte_data(std::istringstream& sstream)
+        constexpr bool is_word_start(char c) noexcept
         {
-            std::vector<std::uint8_t> object_data;
-            for (char c; sstream >> c;)
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '.';
+        }
+
+        constexpr bool is_word_char(char c) noexcept {return is_word_start(c) || is_dec_digit(c);}
+
+        constexpr bool is_blank(char c) noexcept {return c == ' ' || c == '\t' || c == '\r';}
+
+        // splits one line into tokens in place, up to its end or a ';' comment
+        class Lexer
+        {
+            const char*        p;
+            const char*        last;
+            unsigned           line;
+            const std::string* file;
+
+        public:
+            Lexer(Text text, unsigned line, const std::string* file = nullptr) noexcept :
+                p{text.first}, last{text.last}, line{line}, file{file} {}
+
+            Token next()
             {
-                if (c == '"')
+                while (p != last && is_blank(*p))
+                    ++p;
+                if (p == last || *p == ';')
+                    return {Token::end, {p, p}};
+
+                const char* const first = p;
+                if (is_word_start(*p))
                 {
-                    while (sstream.get(c) && c != '"')
-                        object_data.push_back(c);
+                    while (++p != last && is_word_char(*p));
+                    return {Token::word, {first, p}};
                 }
-                else if (c != ',')
+                if (is_dec_digit(*p))
                 {
-                    if (!is_dec_digit(c))
-                        return {};
+                    std::uint64_t value = 0;
+                    // saturates past 48 bits, far beyond anything an operand takes
+                    if (*p == '0' && last - p > 2 && (p[1] == 'x' || p[1] == 'X') && hex_digit_value(p[2]) >= 0)
+                        for (p += 2; p != last && hex_digit_value(*p) >= 0; ++p)
+                            value = std::min<std::uint64_t>(value << 4 | hex_digit_value(*p), 1ull << 48);
                     else
-                    {
-                        std::string value{c};
-                        while (sstream.get(c) && c != ',' && c != ' ')
-                            value.push_back(c);
-                        if (value[0] == '0' && value.size() > 2 && value[1] == 'x')
-                            object_data.push_back(std::stoul(value, nullptr, 16));
-                        else
-                        {
-                            if (!is_dec_number(value))
-                                return {};
-                            object_data.push_back(std::stoul(value, nullptr, 10));
-                        }
-                    }
+                        for (; p != last && is_dec_digit(*p); ++p)
+                            value = std::min<std::uint64_t>(value * 10 + (*p - '0'), 1ull << 48);
+                    if (p != last && is_word_char(*p))
+                        fail(line, "malformed number: " + Text{first, std::find_if_not(p, last, is_word_char)}.str(), file);
+                    return {Token::number, {first, p}, value};
+                }
+                if (*p == '"')
+                {
+                    const char* const close = std::find(first + 1, last, '"');
+                    if (close == last)
+                        fail(line, "unterminated string", file);
+                    p = close + 1;
+                    return {Token::string, {first + 1, close}};
                 }
+                if ((*p == '<' || *p == '>') && last - p > 1 && p[1] == *p)
+                {
+                    p += 2;
+                    return {Token::symbol, {first, p}};
+                }
+                return {Token::symbol, {first, ++p}};
             }
-            std::cout << "byte data: ";
-            std::copy(object_data.cbegin(), object_data.cend(), std::ostream_iterator<unsigned>{std::cout, ","});
-            std::cout << std::endl;
-            return object_data;
+
+            Token peek() {return Lexer{*this}.next();}
+
+            // the rest of the line as written, comment included
+            Text rest() const noexcept {return {p, last};}
+        };
+
+        // the forms [first, last) of a mnemonic, false if there is no such mnemonic
+        bool find_mnemonic(Text mnemonic, unsigned& first, unsigned& last) noexcept
+        {
+            const unsigned slot = mnemonic_hash(mnemonic.first, mnemonic.size());
+            if (!mnemonics.last[slot] || !mnemonic.is(forms[mnemonics.first[slot]].mnemonic))
+                return false;
+            first = mnemonics.first[slot];
+            last  = mnemonics.last [slot];
+            return true;
         }
 
-        std::uint16_t parse_instruction(std::string inst, const std::string& inst_params,
-                const std::unordered_map<std::string, unsigned>& labels)
-        {
-            std::cout << inst << ' ' << inst_params;
-            std::vector<std::string> opcode_args;
-            {
-                std::istringstream sstream_params{inst_params};
-                std::string param;
-                unsigned regs = 0;
-                while (std::getline(sstream_params, param, ','))
-                {
-                    auto opcode_arg_pattern = [&](const std::string& hex_str) -> bool {
-                        if (hex_str.size() > 3 - regs)
-                            return false;
-                        std::string opcode_arg(3 - regs - hex_str.size(), '0');
-                        inst.push_back(' ');
-                        inst.append(3 - regs, 'N');
-                        std::copy(hex_str.cbegin(), hex_str.cend(), std::back_inserter(opcode_arg));
-                        opcode_args.push_back(std::move(opcode_arg));
-                        return true;
-                    };
-                    switch (param[0])
-                    {
-                        case '[':
-                        {
-                            if (param != "[I]")
-                                return 0;
-                            inst.push_back(' ');
-                            inst.append(param);
-                            break;
-                        }
-                        case 'v':
+        /*
+         * Evaluates a constant expression over numbers and symbols with C's precedence for
+         * | ^ & << >> + - * / %, unary - + ~ and parentheses. `lookup(name, value)` returns
+         * false for a symbol not known yet, which leaves the value unknown but still checks
+         * the syntax; `unknown` then names the first such symbol.
+         */
+        template<typename Lookup>
+        class Expression
+        {
+            Lexer&             lexer;
+            Lookup&            lookup;
+            unsigned           line;
+            const std::string* file;
+
+            static int precedence(const Token& token) noexcept
+            {
+                if (token.type != Token::symbol)
+                    return 0;
+                switch (*token.text.first)
+                {
+                    case '|': return 1;
+                    case '^': return 2;
+                    case '&': return 3;
+                    case '<': case '>': return token.text.size() == 2 ? 4 : 0;
+                    case '+': case '-': return 5;
+                    case '*': case '/': case '%': return 6;
+                }
+                return 0;
+            }
+
+            void advance()
+            {
+                text.last = token.text.last;
+                token = lexer.next();
+            }
+
+            // wraps around like the unsigned arithmetic it is done in
+            std::int64_t apply(char op, std::int64_t a, std::int64_t b)
+            {
+                const std::uint64_t ua = a, ub = b;
+                switch (op)
+                {
+                    case '|': return a | b;
+                    case '^': return a ^ b;
+                    case '&': return a & b;
+                    case '+': return ua + ub;
+                    case '-': return ua - ub;
+                    case '*': return ua * ub;
+                    case '<': case '>':
+                        if (b < 0 || b > 63)
                         {
-                            if (param.size() != 2 || regs > 1 || !is_hex_digit(param[1]))
-                                return 0;
-                            opcode_args.push_back({param[1]});
-                            inst.append(" v");
-                            inst.push_back(!regs++ ? 'X' : 'Y');
-                            break;
+                            if (known())
+                                fail(line, "shift out of range", file);
+                            return 0;
                         }
-                        default:
+                        return op == '<' ? std::int64_t(ua << b) : a >> b;
+                    default:
+                        if (!b)
                         {
-                            if (is_dec_digit(param[0]))
-                            {
-                                std::string hex_str;
-                                if (param[0] == '0' && param.size() > 2 && param[1] == 'x')
-                                {
-                                    if (!is_hex_number(hex_str = param.substr(2)))
-                                        return 0;
-                                }
-                                else
-                                {
-                                    if (!is_dec_number(param))
-                                        return 0;
-                                    hex_str = to_hex_string(std::stoul(param, nullptr, 10));
-                                }
-                                if (!opcode_arg_pattern(hex_str))
-                                    return 0;
-                            }
-                            else
-                            {
-                                const auto label_iter = labels.find(param);
-                                if (label_iter == labels.cend())
-                                {
-                                    inst.push_back(' ');
-                                    inst.append(param);
-                                }
-                                else if (!opcode_arg_pattern(to_hex_string(label_iter->second)))
-                                    return 0;
-                            }
-                            break;
+                            if (known())
+                                fail(line, "division by zero", file);
+                            return 0;
                         }
-                    }
+                        if (b == -1) // INT64_MIN / -1 overflows
+                            return op == '/' ? std::int64_t(0 - ua) : 0;
+                        return op == '/' ? a / b : a % b;
                 }
             }
-            const auto inst_iter = instructions.find(inst);
-            if (inst_iter == instructions.cend())
-                return 0;
-            std::string final_opcode_str;
-            for (unsigned opcode_arg_index = 0, i = 0; i < inst_iter->second.length(); ++i)
+
+            std::int64_t unary()
             {
-                if (is_hex_digit(inst_iter->second[i]))
-                    final_opcode_str.push_back(inst_iter->second[i]);
-                else
+                if (token.type == Token::symbol && (token.text == "-" || token.text == "+" || token.text == "~"))
+                {
+                    const char op = *token.text.first;
+                    advance();
+                    const std::int64_t value = unary();
+                    return op == '-' ? std::int64_t(0 - std::uint64_t(value)) : op == '~' ? ~value : value;
+                }
+                if (token.type == Token::number)
+                {
+                    const std::int64_t value = token.value;
+                    advance();
+                    return value;
+                }
+                if (token.type == Token::word)
+                {
+                    const Text name = token.text;
+                    advance();
+                    std::int64_t value = 0;
+                    if (!lookup(name, value) && !unknown.first)
+                        unknown = name;
+                    return value;
+                }
+                if (token.text == "(")
                 {
-                    for (char c : opcode_args[opcode_arg_index])
-                        final_opcode_str.push_back(c);
-                    i += opcode_args[opcode_arg_index++].length() - 1;
+                    advance();
+                    const std::int64_t value = binary(1);
+                    if (token.text != ")")
+                        fail(line, "expected ')'", file);
+                    advance();
+                    return value;
                 }
+                fail(line, token.type == Token::end ? "expected an expression" :
+                        "expected an expression, got '" + token.text.str() + "'", file);
+            }
+
+            std::int64_t binary(int level)
+            {
+                std::int64_t value = unary();
+                for (int p; (p = precedence(token)) >= level;)
+                {
+                    const char op = *token.text.first;
+                    advance();
+                    value = apply(op, value, binary(p + 1));
+                }
+                return value;
+            }
+
+        public:
+            Token token;    // the first token after the expression once evaluated
+            Text  text;     // the expression as written
+            Text  unknown;  // the first symbol not known yet, or empty
+
+            Expression(Lexer& lexer, Token first, Lookup& lookup, unsigned line, const std::string* file) :
+                lexer(lexer), lookup(lookup), line{line}, file{file}, token{first}, text{first.text.first, first.text.first} {}
+
+            std::int64_t evaluate() {return binary(1);}
+
+            bool known() const noexcept {return !unknown.first;}
+        };
+
+        constexpr std::int64_t field_limit(Operand field) noexcept
+        {
+            return field == Operand::nnn ? 0x1000 : field == Operand::n ? 0x10 : 0x100;
+        }
+
+        // a field takes its values and their negations as two's complement
+        constexpr bool fits(std::int64_t value, Operand field) noexcept
+        {
+            return value >= -field_limit(field) / 2 && value < field_limit(field);
+        }
+
+        // an expression whose value goes into the object code at `offset` once every symbol is defined
+        struct Fixup
+        {
+            std::size_t        offset;
+            Text               expression;
+            Operand            field;
+            unsigned           line;
+            const std::string* file;
+        };
+
+        void patch(std::uint8_t* code, const Fixup& fixup, std::int64_t value, unsigned line, const std::string* file)
+        {
+            if (!fits(value, fixup.field))
+                fail(line, "out of range: " + fixup.expression.str(), file);
+            value &= field_limit(fixup.field) - 1;
+            if (fixup.field == Operand::byte)
+                code[0] = value;
+            else
+            {
+                code[0] |= value >> 8;
+                code[1] |= value & 0xFF;
             }
-            std::cout << "\t\t  -->  \t" << final_opcode_str << std::endl;
-            return std::stoul(final_opcode_str, nullptr, 16);
         }
 
-        std::vector<std::uint8_t> parse_compiled_line(const std::string& line,
-                std::unordered_map<std::string, unsigned>& labels)
+        // a label, or an equ constant whose expression used symbols not defined before it
+        struct Symbol
+        {
+            std::int64_t       value;
+            Text               expression;  // empty for a label
+            unsigned           line;
+            const std::string* file;
+        };
+
+        using SymbolTable = std::unordered_map<Text, Symbol, TextHash>;
+
+        struct Macro
+        {
+            std::vector<Text> parameters;
+            Text              body;         // the lines between the macro line and endm
+        };
+
+        constexpr std::uint64_t mix_hash(std::uint64_t hash, std::uint64_t value) noexcept
+        {
+            return ((hash ^ value) * 0xFF51AFD7ED558CCDull) ^ ((hash ^ value) * 0xFF51AFD7ED558CCDull) >> 32;
+        }
+
+        // what the statements before a point define for those after it, hashed in definition order
+        struct Environment
         {
-            std::vector<std::uint8_t> bytes;
-            std::istringstream sstream_line{line};
-            std::string first_word;
-            sstream_line >> first_word;
-            if (first_word == "byte") // is it byte data?
+            std::unordered_map<Text, Macro, TextHash>        macros;
+            std::unordered_map<Text, std::int64_t, TextHash> constants;   // equ known where defined
+            std::uint64_t                                    hash = 0;
+
+            bool define(Text name, std::int64_t value)
             {
-                const std::vector<std::uint8_t> byte_data{parse_byte_data(sstream_line)};
-                if (byte_data.size())
-                    std::copy(byte_data.cbegin(), byte_data.cend(), std::back_inserter(bytes));
+                if (!constants.emplace(name, value).second)
+                    return false;
+                hash = mix_hash(hash, TextHash{}(name) ^ std::uint64_t(value) * 0x9E3779B97F4A7C15ull);
+                return true;
             }
-            else // maybe it's an instruction
+
+            bool define(Text name, const Macro& macro)
             {
-                std::string next_line_part; // parameters
-                std::getline(sstream_line, next_line_part);
-                next_line_part.erase(
-                        std::remove(next_line_part.begin(), next_line_part.end(), ' '), next_line_part.end());
-                const std::uint16_t opcode = parse_instruction(std::move(first_word), next_line_part, labels);
-                if (opcode)
+                if (!macros.emplace(name, macro).second)
+                    return false;
+                std::uint64_t value = TextHash{}(name) ^ TextHash{}(macro.body);
+                for (Text parameter : macro.parameters)
+                    value = mix_hash(value, TextHash{}(parameter));
+                hash = mix_hash(hash, value);
+                return true;
+            }
+        };
+
+        /*
+         * Looks symbols up once all of them are defined: labels and constants by value, constants
+         * kept as expressions by evaluating those, which may use other such constants in turn.
+         */
+        class Resolver
+        {
+            const SymbolTable&                                      symbols;
+            const std::unordered_map<Text, std::int64_t, TextHash>* constants;
+            unsigned                                                depth = 0;
+
+        public:
+            Resolver(const SymbolTable& symbols, const std::unordered_map<Text, std::int64_t, TextHash>* constants) noexcept :
+                symbols(symbols), constants{constants} {}
+
+            bool operator()(Text name, std::int64_t& value)
+            {
+                if (constants)
+                {
+                    const auto constant = constants->find(name);
+                    if (constant != constants->cend())
+                    {
+                        value = constant->second;
+                        return true;
+                    }
+                }
+                const auto symbol = symbols.find(name);
+                if (symbol == symbols.cend())
+                    return false;
+                if (!symbol->second.expression.first)
+                    value = symbol->second.value;
+                else
+                {
+                    if (depth == 32)
+                        fail(symbol->second.line, "equ refers to itself: " + name.str(), symbol->second.file);
+                    ++depth;
+                    value = evaluate(symbol->second.expression, symbol->second.line, symbol->second.file);
+                    --depth;
+                }
+                return true;
+            }
+
+            // the value of a whole expression, failing on a symbol defined nowhere
+            std::int64_t evaluate(Text text, unsigned line, const std::string* file)
+            {
+                std::int64_t value;
+                // most are a label alone, looked up without lexing
+                if (is_word_start(*text.first) && std::all_of(text.first, text.last, is_word_char))
+                {
+                    if (!(*this)(text, value))
+                        fail(line, "undefined symbol: " + text.str(), file);
+                    return value;
+                }
+                Lexer lexer{text, line, file};
+                Expression<Resolver> expression{lexer, lexer.next(), *this, line, file};
+                value = expression.evaluate();
+                if (!expression.known())
+                    fail(line, "undefined symbol: " + expression.unknown.str(), file);
+                return value;
+            }
+        };
+
+        // a whole source file, mapped read-only where the system allows it and read in one go elsewhere
+        class SourceFile
+        {
+            const char* text = nullptr;
+            std::size_t length = 0;
+#ifdef CHIP8_POSIX_FILES
+            int         fd;
+#else
+            std::string contents;
+#endif
+
+        public:
+            explicit SourceFile(const std::string& filepath)
+            {
+#ifdef CHIP8_POSIX_FILES
+                fd = ::open(filepath.c_str(), O_RDONLY);
+                struct stat status;
+                if (fd < 0 || ::fstat(fd, &status))
                 {
-                    bytes.push_back(opcode >> 8 & 0xFF);
-                    bytes.push_back(opcode      & 0xFF);
+                    if (fd >= 0)
+                        ::close(fd);
+                    throw std::runtime_error{"there is no such a file " + filepath};
                 }
+                length = status.st_size;
+                if (!length) // an empty file cannot be mapped
+                    return;
+                void* const data = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data == MAP_FAILED)
+                {
+                    ::close(fd);
+                    throw std::runtime_error{"it is failed to map a file: " + filepath};
+                }
+                ::madvise(data, length, MADV_SEQUENTIAL);
+                text = static_cast<const char*>(data);
+#else
+                std::ifstream stream{filepath, std::ios::in | std::ios::binary};
+                if (!stream)
+                    throw std::runtime_error{"there is no such a file " + filepath};
+                stream.seekg(0, std::ios::end);
+                contents.resize(stream.tellg());
+                stream.seekg(0, std::ios::beg);
+                stream.read(&contents[0], contents.size());
+                text   = contents.data();
+                length = contents.size();
+#endif
             }
-            return bytes;
+
+            ~SourceFile()
+            {
+#ifdef CHIP8_POSIX_FILES
+                if (length)
+                    ::munmap(const_cast<char*>(text), length);
+                ::close(fd);
+#endif
+            }
+
+            SourceFile(const SourceFile&) = delete;
+            SourceFile& operator=(const SourceFile&) = delete;
+
+            const char* begin() const noexcept {return text;}
+            const char* end()   const noexcept {return text + length;}
+        };
+
+        // `name` as written in an include of `including`: absolute, or relative to the including file
+        std::string include_path(const std::string& including, Text name)
+        {
+            if (name.size() && *name.first == '/')
+                return name.str();
+            const std::size_t slash = including.find_last_of('/');
+            return (slash == std::string::npos ? std::string{} : including.substr(0, slash + 1)) + name.str();
         }
 
-        unsigned byte_data_size(std::istringstream& sstream)
+        // a statement for the listing
+        struct ListingLine
+        {
+            Text        source;
+            std::size_t offset, size;
+            unsigned    line;
+        };
+
+        // what a chunk defines, in order
+        struct Definition
+        {
+            enum Kind : unsigned char {label, constant, expression, macro};
+
+            Kind         kind;
+            Text         name;
+            std::int64_t value;         // a label's offset into the chunk, or a constant
+            Text         text;          // of an expression
+            Macro        body;
+            unsigned     line;
+        };
+
+        // a run of source lines assembled on its own, every operand using a label left as a fixup
+        struct Chunk
         {
-            unsigned size = 0;
-            for (char c; sstream >> c;)
+            std::string               text;         // a copy of the lines, the Texts below point into it or into expansions
+            std::uint64_t             environment;  // the hash of the environment it was assembled in
+            std::vector<std::uint8_t> object_code;
+            std::vector<Definition>   definitions;
+            std::vector<Fixup>        fixups;       // lines counted from the chunk's first
+            std::deque<std::string>   expansions;   // of macros
+            std::uint64_t             build;        // the last build that used the chunk
+        };
+
+        /*
+         * Assembles a source in one pass. Operands and byte data are constant expressions; one
+         * using a symbol not defined yet leaves its bits zero and a fixup, patched once the whole
+         * source has been read. Macros expand in place, includes are assembled where they stand.
+         */
+        class Assembler
+        {
+            struct Argument
+            {
+                Operand      kind;          // vx for registers, nnn for expressions
+                std::int64_t value;
+                Text         expression;    // one using symbols not defined yet, or empty
+            };
+
+            const unsigned     origin;
+            const bool         relocatable;
+            unsigned           line_base;   // the line before the first one assembled
+            unsigned           line = 0;
+            const std::string* file;        // an included file, or null for the source itself
+            const std::string  path;        // of the source itself, includes are relative to it
+            const std::uint64_t unique_base;
+            unsigned           includes_open = 0, expansions_open = 0, expansions_made = 0;
+
+            Environment  own_environment;
+            Environment& environment;
+
+            std::vector<std::uint8_t>                object_code;
+            SymbolTable                              symbols;
+            std::vector<Fixup>                       fixups;
+            std::vector<Definition>                  definitions;   // relocatable only
+            std::deque<std::string>                  expansions;
+            std::deque<std::string>                  file_names;
+            std::vector<std::unique_ptr<SourceFile>> includes;
+            std::vector<ListingLine>*                listing;
+
+            // the macro being defined, with its body starting at the line after the macro line
+            bool        defining = false;
+            Text        macro_name;
+            Macro       macro;
+            const char* body_first = nullptr;
+            unsigned    macro_line = 0;
+
+            [[noreturn]] void error(const std::string& message) const
+            {
+                fail(line_base + line, message, file);
+            }
+
+            // the object code lives in a buffer reserved up to the end of memory and never grows past it
+            void room(std::size_t size) const
+            {
+                if (size > object_code.capacity() - object_code.size())
+                    error("the program does not fit below 0x1000");
+            }
+
+            bool lookup(Text name, std::int64_t& value) const
+            {
+                const auto constant = environment.constants.find(name);
+                if (constant != environment.constants.cend())
+                {
+                    value = constant->second;
+                    return true;
+                }
+                if (relocatable) // labels are only placed by the linker
+                    return false;
+                const auto symbol = symbols.find(name);
+                if (symbol == symbols.cend() || symbol->second.expression.first)
+                    return false;
+                value = symbol->second.value;
+                return true;
+            }
+
+            // evaluates the expression at `token`, leaving it at the token after; `pending` is set if it is unknown yet
+            std::int64_t evaluate(Lexer& lexer, Token& token, Text& pending)
+            {
+                auto known = [this](Text name, std::int64_t& value) {return lookup(name, value);};
+                Expression<decltype(known)> expression{lexer, token, known, line_base + line, file};
+                const std::int64_t value = expression.evaluate();
+                token   = expression.token;
+                pending = expression.known() ? Text{} : expression.text;
+                return value;
+            }
+
+            // registers and keywords stand alone, anything else is an expression
+            Argument parse_argument(Lexer& lexer, Token& token)
+            {
+                if (token.text == "[")
+                {
+                    const Token reg = lexer.next(), close = lexer.next();
+                    if (reg.text != "I" || close.text != "]")
+                        error("expected [I]");
+                    token = lexer.next();
+                    return {Operand::I_ref, 0, {}};
+                }
+                const Token after = lexer.peek();
+                if (token.type == Token::word && (after.type == Token::end || after.text == ","))
+                {
+                    const Text text = token.text;
+                    Argument argument{Operand::nnn, 0, {}};
+                    if (text.size() == 2 && (text.first[0] == 'v' || text.first[0] == 'V') && hex_digit_value(text.first[1]) >= 0)
+                        argument = {Operand::vx, hex_digit_value(text.first[1]), {}};
+                    else if (text == "I")  argument.kind = Operand::I;
+                    else if (text == "DT") argument.kind = Operand::DT;
+                    else if (text == "ST") argument.kind = Operand::ST;
+                    else if (text == "F")  argument.kind = Operand::F;
+                    else if (text == "B")  argument.kind = Operand::B;
+                    else if (text == "K" || text == "N") argument.kind = Operand::K; // ld vX, N as well
+                    if (argument.kind != Operand::nnn)
+                    {
+                        token = lexer.next();
+                        return argument;
+                    }
+                }
+                Argument argument{Operand::nnn, 0, {}};
+                argument.value = evaluate(lexer, token, argument.expression);
+                return argument;
+            }
+
+            static bool accepts(Operand operand, const Argument& argument) noexcept
             {
-                if (c == '"')
+                switch (operand)
                 {
-                    while (sstream.get(c) && c != '"')
-                        ++size;
+                    case Operand::vx: case Operand::vy: case Operand::vxy:
+                        return argument.kind == Operand::vx;
+                    case Operand::v0:
+                        return argument.kind == Operand::vx && !argument.value;
+                    case Operand::nnn: case Operand::nn: case Operand::n:
+                        return argument.kind == Operand::nnn && (argument.expression.first || fits(argument.value, operand));
+                    default:
+                        return argument.kind == operand;
                 }
-                else if (c != ',')
+            }
+
+            void instruction(Text mnemonic, unsigned first_form, unsigned last_form, Lexer& lexer)
+            {
+                Argument arguments[3];
+                unsigned count = 0;
+                Token token = lexer.next();
+                if (token.type != Token::end)
+                    for (;;)
+                    {
+                        if (count == 3)
+                            error("too many operands");
+                        arguments[count++] = parse_argument(lexer, token);
+                        if (token.type == Token::end)
+                            break;
+                        if (token.text != ",")
+                            error("expected ',' before '" + token.text.str() + "'");
+                        token = lexer.next();
+                    }
+
+                for (unsigned i = first_form; i < last_form; ++i)
                 {
-                    if (!is_dec_digit(c))
-                        return {};
+                    const Form& form = forms[i];
+                    if (form.count != count || !std::equal(form.operands, form.operands + count, arguments, accepts))
+                        continue;
+
+                    unsigned opcode = form.opcode;
+                    for (unsigned k = 0; k < count; ++k)
+                        switch (form.operands[k])
+                        {
+                            case Operand::vx:  opcode |= arguments[k].value << 8; break;
+                            case Operand::vy:  opcode |= arguments[k].value << 4; break;
+                            case Operand::vxy: opcode |= arguments[k].value * 0x110; break;
+                            case Operand::nnn: case Operand::nn: case Operand::n:
+                                if (arguments[k].expression.first)
+                                    fixups.push_back({object_code.size(), arguments[k].expression, form.operands[k], line, file});
+                                else
+                                    opcode |= arguments[k].value & (field_limit(form.operands[k]) - 1);
+                                break;
+                            default:
+                                break;
+                        }
+                    room(2);
+                    object_code.push_back(opcode >> 8);
+                    object_code.push_back(opcode & 0xFF);
+                    return;
+                }
+                error("no form of " + mnemonic.str() + " takes these operands");
+            }
+
+            // byte "text", 1, SIZE * 2 ...: strings and expressions, commas between them optional
+            void byte_data(Lexer& lexer)
+            {
+                const std::size_t size = object_code.size();
+                for (Token token = lexer.next(); token.type != Token::end;)
+                {
+                    if (token.type == Token::string)
+                    {
+                        room(token.text.size());
+                        object_code.insert(object_code.end(), token.text.first, token.text.last);
+                        token = lexer.next();
+                    }
                     else
                     {
-                        std::string value{c};
-                        while (sstream.get(c) && c != ',' && c != ' ')
-                            value.push_back(c);
-                        if (value[0] == '0' && value.size() > 2 && value[1] == 'x')
-                            ++size;
-                        else
+                        Text pending;
+                        const std::int64_t value = evaluate(lexer, token, pending);
+                        if (!pending.first && !fits(value, Operand::byte))
+                            error("not a byte: " + std::to_string(value));
+                        room(1);
+                        if (pending.first)
+                            fixups.push_back({object_code.size(), pending, Operand::byte, line, file});
+                        object_code.push_back(pending.first ? 0 : value & 0xFF);
+                    }
+                    if (token.text == ",")
+                        token = lexer.next();
+                }
+                if (object_code.size() == size)
+                    error("byte without data");
+            }
+
+            void define_label(Text name)
+            {
+                if (environment.constants.count(name)
+                        || !symbols.emplace(name, Symbol{std::int64_t(origin + object_code.size()), {}, line_base + line, file}).second)
+                    error("label defined twice: " + name.str());
+                if (relocatable)
+                    definitions.push_back({Definition::label, name, std::int64_t(object_code.size()), {}, {}, line});
+            }
+
+            // NAME equ expression
+            void equ(Text name, Lexer& lexer)
+            {
+                Token token = lexer.next();
+                Text pending;
+                const std::int64_t value = evaluate(lexer, token, pending);
+                if (token.type != Token::end)
+                    error("unexpected '" + token.text.str() + "' after the expression");
+                if (symbols.count(name) || environment.constants.count(name))
+                    error("defined twice: " + name.str());
+
+                if (pending.first)
+                    symbols.emplace(name, Symbol{0, pending, line_base + line, file});
+                else
+                    environment.define(name, value);
+                if (relocatable)
+                    definitions.push_back({pending.first ? Definition::expression : Definition::constant, name, value, pending, {}, line});
+            }
+
+            static bool reserved(Text name) noexcept
+            {
+                unsigned first, last;
+                return find_mnemonic(name, first, last) || name == "byte" || name == "include"
+                        || name == "equ" || name == "macro" || name == "endm";
+            }
+
+            // NAME macro [parameter, ...], the body follows up to endm
+            void begin_macro(Text name, Lexer& lexer)
+            {
+                if (expansions_open)
+                    error("macro inside a macro");
+                if (reserved(name))
+                    error("macro named like an instruction: " + name.str());
+
+                macro = Macro{};
+                Token token = lexer.next();
+                if (token.type != Token::end)
+                    for (;;)
+                    {
+                        if (token.type != Token::word)
+                            error("expected a parameter name, got '" + token.text.str() + "'");
+                        macro.parameters.push_back(token.text);
+                        token = lexer.next();
+                        if (token.type == Token::end)
+                            break;
+                        if (token.text != ",")
+                            error("expected ',' before '" + token.text.str() + "'");
+                        token = lexer.next();
+                    }
+                defining   = true;
+                macro_name = name;
+                macro_line = line;
+            }
+
+            void end_macro(const char* body_last)
+            {
+                macro.body = {body_first, body_last};
+                defining   = false;
+                body_first = nullptr;
+                if (!environment.define(macro_name, macro))
+                    fail(line_base + macro_line, "macro defined twice: " + macro_name.str(), file);
+                if (relocatable)
+                    definitions.push_back({Definition::macro, macro_name, 0, {}, macro, macro_line});
+            }
+
+            // the arguments of a macro: the rest of the line cut at commas outside strings and parentheses
+            std::vector<Text> split_arguments(Text rest) const
+            {
+                std::vector<Text> arguments;
+                const auto push = [&arguments](const char* first, const char* last) {
+                    first = std::find_if_not(first, last, is_blank);
+                    while (last != first && is_blank(last[-1]))
+                        --last;
+                    arguments.push_back({first, last});
+                };
+                const char* p     = rest.first;
+                const char* start = p;
+                for (int depth = 0; p != rest.last && *p != ';'; ++p)
+                    if (*p == '"')
+                    {
+                        if ((p = std::find(p + 1, rest.last, '"')) == rest.last)
+                            error("unterminated string");
+                    }
+                    else if (*p == '(' || *p == ')')
+                        depth += *p == '(' ? 1 : -1;
+                    else if (*p == ',' && !depth)
+                    {
+                        push(start, p);
+                        start = p + 1;
+                    }
+                push(start, p);
+                if (arguments.size() == 1 && !arguments.front().size())
+                    arguments.clear();
+                for (Text argument : arguments)
+                    if (!argument.size())
+                        error("empty macro argument");
+                return arguments;
+            }
+
+            void expand(Text name, const Macro& invoked, Text rest)
+            {
+                const std::vector<Text> arguments{split_arguments(rest)};
+                if (arguments.size() != invoked.parameters.size())
+                    error(name.str() + " takes " + std::to_string(invoked.parameters.size())
+                            + (invoked.parameters.size() == 1 ? " argument" : " arguments"));
+                if (expansions_open == 16)
+                    error("macros nest too deep");
+
+                // parameters are replaced outside strings and comments, \@ by a number unique to the expansion
+                const std::string unique{std::to_string(unique_base + ++expansions_made)};
+                expansions.emplace_back();
+                std::string& text = expansions.back();
+                text.reserve(invoked.body.size());
+                for (const char* p = invoked.body.first, * last = invoked.body.last; p != last;)
+                {
+                    const char* next;
+                    if (*p == '"')
+                    {
+                        next = std::find_if(p + 1, last, [](char c) {return c == '"' || c == '\n';});
+                        next += next != last && *next == '"';
+                        text.append(p, next);
+                    }
+                    else if (*p == ';')
+                        text.append(p, next = std::find(p, last, '\n'));
+                    else if (*p == '\\' && last - p > 1 && p[1] == '@')
+                    {
+                        text += unique;
+                        next = p + 2;
+                    }
+                    else if (is_word_char(*p))
+                    {
+                        next = std::find_if_not(p, last, is_word_char);
+                        const auto parameter = std::find(invoked.parameters.cbegin(), invoked.parameters.cend(), Text{p, next});
+                        if (is_word_start(*p) && parameter != invoked.parameters.cend())
                         {
-                            if (!is_dec_number(value))
-                                return {};
-                            ++size;
+                            const Text argument = arguments[parameter - invoked.parameters.cbegin()];
+                            text.append(argument.first, argument.last);
                         }
+                        else
+                            text.append(p, next);
+                    }
+                    else
+                    {
+                        text.push_back(*p);
+                        next = p + 1;
                     }
+                    p = next;
                 }
+
+                ++expansions_open;
+                assemble(text.data(), text.data() + text.size(), false);
+                --expansions_open;
+            }
+
+            void include(Text name)
+            {
+                if (includes_open == 16)
+                    error("includes nest too deep");
+                file_names.push_back(include_path(file ? *file : path, name));
+                try
+                {
+                    includes.emplace_back(new SourceFile{file_names.back()});
+                }
+                catch (const std::exception& ex)
+                {
+                    error(ex.what());
+                }
+
+                const std::string* const outer_file = file;
+                const unsigned outer_line = line, outer_base = line_base;
+                file      = &file_names.back();
+                line      = 0;
+                line_base = 0;
+                ++includes_open;
+                assemble(includes.back()->begin(), includes.back()->end());
+                --includes_open;
+                file      = outer_file;
+                line      = outer_line;
+                line_base = outer_base;
+            }
+
+            void statement(Text source)
+            {
+                Lexer lexer{source, line_base + line, file};
+                Token token = lexer.next();
+                if (token.type == Token::word)
+                {
+                    const Token next = lexer.peek();
+                    if (next.text == "equ" || next.text == "macro")
+                    {
+                        lexer.next();
+                        next.text == "equ" ? equ(token.text, lexer) : begin_macro(token.text, lexer);
+                        return;
+                    }
+                }
+
+                bool labelled = false;
+                if (token.type == Token::word && lexer.peek().text == ":")
+                {
+                    define_label(token.text);
+                    lexer.next();
+                    token    = lexer.next();
+                    labelled = true;
+                }
+                if (token.type == Token::end)
+                    return;
+                if (token.type != Token::word)
+                    error("expected an instruction, got '" + token.text.str() + "'");
+
+                if (token.text == "endm")
+                    error("endm without macro");
+                if (token.text == "include")
+                {
+                    const Token name = lexer.next();
+                    if (labelled || expansions_open)
+                        error("include takes a line of its own outside macros");
+                    if (name.type != Token::string || lexer.next().type != Token::end)
+                        error("include takes a file name in quotes");
+                    include(name.text);
+                    return;
+                }
+
+                const std::size_t offset = object_code.size();
+                unsigned first_form, last_form;
+                if (token.text == "byte")
+                    byte_data(lexer);
+                else if (find_mnemonic(token.text, first_form, last_form))
+                    instruction(token.text, first_form, last_form, lexer);
+                else
+                {
+                    const auto invoked = environment.macros.find(token.text);
+                    if (invoked == environment.macros.cend())
+                        error("unknown instruction: " + token.text.str());
+                    expand(token.text, invoked->second, lexer.rest());
+                    return;
+                }
+                if (listing)
+                    listing->push_back({source, offset, object_code.size() - offset, line});
+            }
+
+            static bool is_endm(Text source)
+            {
+                Lexer lexer{source, 0};
+                const Token token = lexer.peek();
+                return token.text == "endm";
+            }
+
+            // the lines of [first, last), counted unless they are a macro's expansion
+            void assemble(const char* first, const char* last, bool counted)
+            {
+                while (first != last)
+                {
+                    const char* const end  = static_cast<const char*>(std::memchr(first, '\n', last - first));
+                    const char* const next = end ? end + 1 : last;
+                    line += counted;
+                    const Text source{first, end ? end : last};
+                    if (!defining)
+                    {
+                        statement(source);
+                        if (defining)
+                            body_first = next;
+                    }
+                    else if (is_endm(source))
+                    {
+                        Lexer lexer{source, line_base + line, file};
+                        lexer.next();
+                        if (lexer.next().type != Token::end)
+                            error("endm takes nothing after it");
+                        end_macro(first);
+                    }
+                    first = next;
+                }
+                if (defining && counted)
+                    fail(line_base + macro_line, "macro without endm: " + macro_name.str(), file);
+            }
+
+        public:
+            Assembler(unsigned origin, std::vector<ListingLine>* listing, const std::string& path = {}) :
+                origin{origin}, relocatable{false}, line_base{0}, file{nullptr}, path{path}, unique_base{0},
+                environment(own_environment), listing{listing}
+            {
+                if (origin >= 0x1000)
+                    throw std::runtime_error{"the program starts past the end of memory"};
+                object_code.reserve(0x1000 - origin);
+            }
+
+            // assembles a chunk of `file` after `line_base` lines, labels left to the linker and definitions kept
+            Assembler(Environment& environment, unsigned line_base, const std::string* file, std::uint64_t unique_base) :
+                origin{0}, relocatable{true}, line_base{line_base}, file{file}, unique_base{unique_base},
+                environment(environment), listing{nullptr}
+            {
+                object_code.reserve(0x1000);
+            }
+
+            void assemble(const char* first, const char* last)
+            {
+                assemble(first, last, true);
+            }
+
+            std::vector<std::uint8_t> finish()
+            {
+                Resolver resolve{symbols, &environment.constants};
+                for (const Fixup& fixup : fixups)
+                    patch(&object_code[fixup.offset], fixup, resolve.evaluate(fixup.expression, fixup.line, fixup.file),
+                            fixup.line, fixup.file);
+                return std::move(object_code);
+            }
+
+            // hands the unresolved object code, the definitions, the fixups and the expansions over to a chunk
+            void finish(Chunk& chunk)
+            {
+                chunk.object_code = std::move(object_code);
+                chunk.object_code.shrink_to_fit();
+                chunk.definitions = std::move(definitions);
+                chunk.fixups      = std::move(fixups);
+                chunk.expansions  = std::move(expansions);
+            }
+        };
+
+        // one line per statement: its address, up to four of its bytes and its source
+        void print_listing(std::ostream& out, const std::vector<ListingLine>& lines,
+                const std::vector<std::uint8_t>& object_code, unsigned origin)
+        {
+            char buffer[40];
+            for (const ListingLine& line : lines)
+            {
+                int length = std::snprintf(buffer, sizeof buffer, "%5u  %03X ", line.line, unsigned(origin + line.offset));
+                for (std::size_t i = 0; i < std::min<std::size_t>(line.size, 4); ++i)
+                    length += std::snprintf(buffer + length, sizeof buffer - length, " %02X", object_code[line.offset + i]);
+                std::snprintf(buffer + length, sizeof buffer - length, "%s", line.size > 4 ? " ..." : "");
+                out << buffer << std::string(std::max(0, 28 - int(std::strlen(buffer))), ' ');
+                out.write(line.source.first, line.source.size()) << '\n';
             }
-            return size;
         }
 
-        unsigned compiled_line_size(const std::string& line)
+        /*
+         * Assembles the source in [first, last) for a program loaded at `PC`, throwing std::runtime_error
+         * with the line of the first error. Includes are found relative to `path`, the source's own.
+         * With a `listing` stream every statement is printed there as well.
+         */
+        std::vector<std::uint8_t> process(const char* first, const char* last, unsigned PC = 0x200,
+                std::ostream* listing = nullptr, const std::string& path = {})
         {
-            std::istringstream sstream_line{line};
-            std::string first_word;
-            sstream_line >> first_word;
-            return first_word == "byte" ? byte_data_size(sstream_line) : 2;
+            std::vector<ListingLine> lines;
+            Assembler assembler{PC, listing ? &lines : nullptr, path};
+            assembler.assemble(first, last);
+            const std::vector<std::uint8_t> object_code{assembler.finish()};
+            if (listing)
+                print_listing(*listing, lines, object_code, PC);
+            return object_code;
         }
 
-        std::vector<std::uint8_t> process(const std::string& source, unsigned PC = 0x200)
+        /*
+         * Assembles a source again and again, e.g. on every save, re-encoding only what changed.
+         * The source is cut into chunks before every label at the start of a line and after lines
+         * picked by their length and ends, about one in 32, so the cuts depend on the content
+         * around them and an edit moves none of them beyond its own chunk. Macro definitions are
+         * never cut, and an include is cut out and replaced by the chunks of the included file.
+         * Chunks are cached by content and by the macros and constants defined before them, and
+         * assembled with every operand using a label left as a fixup; a build looks each chunk up,
+         * assembles the missing ones, then lays them out and patches every fixup. Chunks no
+         * longer in the source are dropped after each build.
+         */
+        class IncrementalAssembler
         {
-            std::vector<std::uint8_t> object_code;
-            std::unordered_map<std::string/*identifier*/, unsigned/*address*/> labels;
-            std::queue<std::string> compiled_lines;
-            std::vector<unsigned> PCs;
-            {
-                std::istringstream sstream_source{source};
-                std::string line;
-                while (std::getline(sstream_source, line))
-                {
-                    auto strip_comment = [](std::string& line) noexcept {
-                        const auto cpos = line.find(';');
-                        if (cpos != std::string::npos)
-                            line.erase(cpos);
-                    };
-                    strip_comment(line);
-                    std::istringstream sstream_line{line};
-                    std::string first_word;
-                    if (sstream_line >> first_word)
+            struct Key
+            {
+                std::uint64_t environment;
+                Text          text;
+
+                friend bool operator==(const Key& a, const Key& b) noexcept
+                {
+                    return a.environment == b.environment && a.text == b.text;
+                }
+            };
+
+            struct KeyHash
+            {
+                std::size_t operator()(const Key& key) const noexcept {return mix_hash(TextHash{}(key.text), key.environment);}
+            };
+
+            struct Placement
+            {
+                const Chunk*       chunk;
+                unsigned           line_base;
+                const std::string* file;
+            };
+
+            std::unordered_map<Key, std::unique_ptr<Chunk>, KeyHash> cache;    // keyed by the chunk's own text
+            std::uint64_t builds = 0;
+            std::size_t   hits = 0, misses = 0;
+
+            std::string                              source_path;
+            std::set<std::string>                    file_names;    // of includes, never dropped as chunks refer to them
+            std::vector<std::string>                 inputs;
+            std::vector<std::unique_ptr<SourceFile>> included;
+            Environment                              environment;
+            std::vector<Placement>                   placements;
+
+            void place(const char* first, const char* last, unsigned line_base, const std::string* file)
+            {
+                const auto cached = cache.find({environment.hash, {first, last}});
+                Chunk* chunk;
+                if (cached != cache.cend())
+                {
+                    ++hits;
+                    chunk = cached->second.get();
+                    for (const Definition& definition : chunk->definitions)
+                        if ((definition.kind == Definition::constant && !environment.define(definition.name, definition.value))
+                                || (definition.kind == Definition::macro && !environment.define(definition.name, definition.body)))
+                            fail(line_base + definition.line, (definition.kind == Definition::macro ? "macro defined twice: " :
+                                    "defined twice: ") + definition.name.str(), file);
+                }
+                else
+                {
+                    std::unique_ptr<Chunk> fresh{new Chunk{{first, last}, environment.hash, {}, {}, {}, {}, 0}};
+                    const Text text{fresh->text.data(), fresh->text.data() + fresh->text.size()};
+                    Assembler assembler{environment, line_base, file, mix_hash(TextHash{}(text), environment.hash) >> 24};
+                    assembler.assemble(text.first, text.last);
+                    assembler.finish(*fresh);
+                    ++misses;
+                    chunk = fresh.get();
+                    cache.emplace(Key{fresh->environment, text}, std::move(fresh));
+                }
+                chunk->build = builds;  // a chunk whose text repeats is placed once per occurrence
+                placements.push_back({chunk, line_base, file});
+            }
+
+            // the word after any blanks at `p`, or an empty Text there
+            static Text word_at(const char* p, const char* last) noexcept
+            {
+                while (p != last && is_blank(*p))
+                    ++p;
+                const char* const first = p;
+                if (p != last && is_word_start(*p))
+                    while (++p != last && is_word_char(*p));
+                return {first, p};
+            }
+
+            void cut(const char* first, const char* last, const std::string* file, unsigned depth)
+            {
+                const char* chunk_first = first;
+                unsigned    chunk_line  = 0, lines = 0, line = 0;
+                bool        in_macro    = false;
+                while (first != last)
+                {
+                    const char* const eol  = static_cast<const char*>(std::memchr(first, '\n', last - first));
+                    const char* const next = eol ? eol + 1 : last;
+                    const Text text{first, eol ? eol : last};
+                    ++line;
+
+                    const Text word = word_at(text.first, text.last);
+                    if (!in_macro && word == "include")
                     {
-                        auto push_compiled_line = [&compiled_lines, &PC](std::string line) noexcept {
-                            PC += compiled_line_size(line);
-                            compiled_lines.push(std::move(line));
-                        };
-                        if (first_word.back() == ':' && first_word.size() > 1) // is it a label?
+                        Lexer lexer{text, line, file};
+                        lexer.next();
+                        const Token name = lexer.next();
+                        if (name.type != Token::string || lexer.next().type != Token::end)
+                            fail(line, "include takes a file name in quotes", file);
+                        if (depth == 16)
+                            fail(line, "includes nest too deep", file);
+                        if (chunk_first != first)
+                            place(chunk_first, first, chunk_line, file);
+
+                        const std::string* const included_name =
+                                &*file_names.insert(include_path(file ? *file : source_path, name.text)).first;
+                        try
                         {
-                            first_word.pop_back(); // remove ':' character
-                            labels.emplace(std::move(first_word), PC);
-                            std::string next_line_part;
-                            if (std::getline(sstream_line, next_line_part)) // is there anything after the label?
-                            {
-                                PCs.push_back(PC);
-                                push_compiled_line(std::move(next_line_part));
-                            }
-                            else
-                            {
-                                for (std::string new_line; std::getline(sstream_source, new_line);)
-                                {
-                                    // does the line contain non-whitespace symbols?
-                                    if (new_line.find_first_not_of(' ') != std::string::npos)
-                                    {
-                                        PCs.push_back(PC);
-                                        strip_comment(new_line);
-                                        push_compiled_line(std::move(new_line));
-                                        break;
-                                    }
-                                }
-                            }
+                            included.emplace_back(new SourceFile{*included_name});
                         }
-                        else // maybe it's a compiled line
+                        catch (const std::exception& ex)
                         {
-                            PCs.push_back(PC);
-                            push_compiled_line(std::move(line));
+                            fail(line, ex.what(), file);
                         }
+                        inputs.push_back(*included_name);
+                        cut(included.back()->begin(), included.back()->end(), included_name, depth + 1);
+
+                        chunk_first = next;
+                        chunk_line  = line;
+                        lines       = 0;
+                        first       = next;
+                        continue;
+                    }
+
+                    if (!in_macro && lines && word.first == first && word.size() && word.last != text.last && *word.last == ':')
+                    {
+                        place(chunk_first, first, chunk_line, file);
+                        chunk_first = first;
+                        chunk_line  = line - 1;
+                        lines       = 0;
+                    }
+                    if (word.size() && !in_macro)
+                    {
+                        const char* const after = std::find_if_not(word.last, text.last, is_blank);
+                        in_macro = after != text.last && *after == 'm' && word_at(after, text.last) == "macro";
+                    }
+                    else if (word == "endm")
+                        in_macro = false;
+
+                    ++lines;
+                    const std::size_t size = next - first;
+                    if (!in_macro && (lines >= 256 || (lines >= 8 && size >= 2
+                            && !((size * 7 + first[0] * 3 + next[-2] * 5 + first[size / 2]) & 31))))
+                    {
+                        place(chunk_first, next, chunk_line, file);
+                        chunk_first = next;
+                        chunk_line  = line;
+                        lines       = 0;
                     }
+                    first = next;
                 }
+                if (chunk_first != last)
+                    place(chunk_first, last, chunk_line, file);
             }
-            // compile all compiled lines
-            for (unsigned i = 0; !compiled_lines.empty(); compiled_lines.pop(), ++i)
+
+        public:
+            // the chunks found in the cache and assembled by the last build
+            std::size_t reused()    const noexcept {return hits;}
+            std::size_t assembled() const noexcept {return misses;}
+
+            // the files the last build included, to be watched along with the source
+            const std::vector<std::string>& included_files() const noexcept {return inputs;}
+
+            std::vector<std::uint8_t> process(const char* first, const char* last, unsigned PC = 0x200,
+                    const std::string& path = {})
             {
-                const std::string& line = compiled_lines.front();
-                std::cout << PCs[i] << ' ';
-                const std::vector<std::uint8_t> bytes{parse_compiled_line(line, labels)};
-                if (bytes.size())
-                    std::copy(bytes.cbegin(), bytes.cend(), std::back_inserter(object_code));
-                else
-                    std::cerr << std::endl << "error" << std::endl;
+                if (PC >= 0x1000)
+                    throw std::runtime_error{"the program starts past the end of memory"};
+                ++builds;
+                hits = misses = 0;
+                inputs.clear();
+                included.clear();
+                placements.clear();
+                environment = Environment{};
+                source_path = path;
+                cut(first, last, nullptr, 0);
+
+                for (auto i = cache.begin(); i != cache.end();)
+                    i = i->second->build == builds ? std::next(i) : cache.erase(i);
+
+                // lays the chunks out and defines their symbols for the whole program
+                std::size_t size = 0;
+                SymbolTable symbols;
+                for (const Placement& placed : placements)
+                {
+                    for (const Definition& definition : placed.chunk->definitions)
+                    {
+                        Symbol symbol{definition.value, {}, placed.line_base + definition.line, placed.file};
+                        if (definition.kind == Definition::label)
+                            symbol.value += PC + size;
+                        else if (definition.kind == Definition::expression)
+                            symbol.expression = definition.text;
+                        else if (definition.kind == Definition::macro)
+                            continue;
+                        if (!symbols.emplace(definition.name, symbol).second)
+                            fail(symbol.line, (definition.kind == Definition::label ? "label defined twice: " : "defined twice: ")
+                                    + definition.name.str(), symbol.file);
+                    }
+                    size += placed.chunk->object_code.size();
+                    if (size > 0x1000 - PC)
+                        fail(placed.line_base + 1, "the chunk from here on does not fit below 0x1000", placed.file);
+                }
+
+                std::vector<std::uint8_t> object_code;
+                object_code.reserve(size);
+                Resolver resolve{symbols, nullptr};
+                for (const Placement& placed : placements)
+                {
+                    const std::size_t offset = object_code.size();
+                    object_code.insert(object_code.end(), placed.chunk->object_code.cbegin(), placed.chunk->object_code.cend());
+                    for (const Fixup& fixup : placed.chunk->fixups)
+                    {
+                        const unsigned line = placed.line_base + fixup.line;
+                        patch(&object_code[offset + fixup.offset], fixup, resolve.evaluate(fixup.expression, line, placed.file),
+                                line, placed.file);
+                    }
+                }
+                return object_code;
             }
-            return object_code;
-        }
+        };
     }
 }
 
@@ -360,28 +1485,224 @@ namespace
         if (!stream)
             throw std::runtime_error{"it is failed to write a file: " + filepath};
         stream.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(std::uint8_t));
+        if (!stream.flush())
+            throw std::runtime_error{"it is failed to write a file: " + filepath};
     }
 
-    std::string read_text_file(const std::string& filepath)
+    // writes next to `filepath` and renames over it, so a reader never sees a partial file
+    void write_binary_file_atomically(const std::string& filepath, const std::vector<std::uint8_t>& data, unsigned job)
     {
-        std::ifstream stream{filepath};
-        if (!stream)
-            throw std::runtime_error{"there is no such a file " + filepath};
-        return {std::istreambuf_iterator<char>{stream}, 
-                std::istreambuf_iterator<char>{}};
+#ifdef CHIP8_POSIX_FILES
+        const std::string temporary{filepath + ".tmp" + std::to_string(::getpid()) + '.' + std::to_string(job)};
+#else
+        const std::string temporary{filepath + ".tmp" + std::to_string(job)};
+#endif
+        try
+        {
+            write_binary_file(temporary, data);
+        }
+        catch (...)
+        {
+            std::remove(temporary.c_str());
+            throw;
+        }
+        if (std::rename(temporary.c_str(), filepath.c_str()))
+        {
+            std::remove(temporary.c_str());
+            throw std::runtime_error{"it is failed to write a file: " + filepath};
+        }
+    }
+
+    bool ends_with(const std::string& str, const std::string& suffix) noexcept
+    {
+        return str.size() >= suffix.size() && std::equal(suffix.rbegin(), suffix.rend(), str.rbegin());
+    }
+
+    // the .src files of a directory in name order, or an empty list if `path` is not a directory
+    std::vector<std::string> list_sources(const std::string& path)
+    {
+        std::vector<std::string> sources;
+#ifdef CHIP8_POSIX_FILES
+        if (DIR* const dir = ::opendir(path.c_str()))
+        {
+            while (const dirent* const entry = ::readdir(dir))
+                if (ends_with(entry->d_name, ".src"))
+                    sources.push_back(path + '/' + entry->d_name);
+            ::closedir(dir);
+            std::sort(sources.begin(), sources.end());
+        }
+#else
+        (void) path;
+#endif
+        return sources;
+    }
+
+    // the source's name with .bin for .src, in `directory` or beside the source
+    std::string output_path(const std::string& source, const std::string& directory)
+    {
+        const std::size_t slash = source.find_last_of('/');
+        std::string name{ends_with(source, ".src") ? source.substr(0, source.size() - 4) : source};
+        name += ".bin";
+        return directory.empty() ? name : directory + '/' + name.substr(slash == std::string::npos ? 0 : slash + 1);
+    }
+
+    struct Job
+    {
+        std::string source, output;
+        std::string listing, error;
+    };
+
+    void assemble(Job& job, unsigned index, unsigned origin, bool listing)
+    {
+        try
+        {
+            const chip8::compiler::SourceFile source{job.source};
+            std::ostringstream listing_stream;
+            write_binary_file_atomically(job.output, chip8::compiler::process(source.begin(), source.end(), origin,
+                    listing ? &listing_stream : nullptr, job.source), index);
+            job.listing = listing_stream.str();
+        }
+        catch (const std::exception& ex)
+        {
+            job.error = ex.what();
+        }
+    }
+
+    // the modification time and size of a file, to notice saves without reading it
+    std::string file_stamp(const std::string& filepath)
+    {
+#ifdef CHIP8_POSIX_FILES
+        struct stat status;
+        if (::stat(filepath.c_str(), &status))
+            return {};
+#ifdef __APPLE__
+        const long nanoseconds = status.st_mtimespec.tv_nsec;
+#else
+        const long nanoseconds = status.st_mtim.tv_nsec;
+#endif
+        return std::to_string(status.st_mtime) + '.' + std::to_string(nanoseconds) + ' ' + std::to_string(status.st_size);
+#else
+        static unsigned polls = 0; // no cheap way to tell, every poll reassembles
+        return filepath + std::to_string(++polls);
+#endif
+    }
+
+    // reassembles the job's source whenever it or a file it includes changes, reusing every chunk left as it was
+    [[noreturn]] void watch(const Job& job, unsigned origin)
+    {
+        chip8::compiler::IncrementalAssembler assembler;
+        for (std::string stamp, last;; std::this_thread::sleep_for(std::chrono::milliseconds{100}))
+        {
+            stamp = file_stamp(job.source);
+            for (const std::string& included : assembler.included_files())
+                stamp += '|' + file_stamp(included);
+            if (stamp == last)
+                continue;
+            last = stamp;
+            const auto start = std::chrono::steady_clock::now();
+            try
+            {
+                const chip8::compiler::SourceFile source{job.source};
+                const std::vector<std::uint8_t> object_code{assembler.process(source.begin(), source.end(), origin, job.source)};
+                write_binary_file_atomically(job.output, object_code, 0);
+                const std::chrono::duration<double, std::milli> took{std::chrono::steady_clock::now() - start};
+                std::cout << job.output << ": " << object_code.size() << " bytes, " << assembler.assembled() << " of "
+                          << assembler.assembled() + assembler.reused() << " chunks assembled in " << took.count()
+                          << " ms" << std::endl;
+            }
+            catch (const std::exception& ex)
+            {
+                std::cerr << job.source << ": " << ex.what() << std::endl;
+            }
+        }
     }
 }
 
-int main()
+// chip8-compiler [-o output | -d directory] [-a load-address] [-j jobs] [-l] [-w] [source | directory]...
+// each source is assembled into -o, into -d, or beside itself with .bin for .src; a directory stands for
+// its .src files. Sources are assembled on `jobs` threads and every output is replaced atomically.
+// -l prints a listing of every source. -w watches a single source and reassembles it incrementally on
+// every change until interrupted. Without sources res/chip8_src/chip8_program.src is assembled
+// into res/chip8_bin/chip8_program.bin.
+int main(int argc, char* argv[])
 {
     try
     {
-        write_binary_file("res/chip8_bin/chip8_program.bin",
-                chip8::compiler::process(read_text_file("res/chip8_src/chip8_program.src")));
+        std::string output, directory;
+        unsigned    origin = 0x200;
+        unsigned    jobs   = std::thread::hardware_concurrency();
+        bool        listing = false, watching = false;
+
+        std::vector<Job> queue;
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg{argv[i]};
+            if ((arg == "-o" || arg == "-d" || arg == "-a" || arg == "-j") && i + 1 < argc)
+            {
+                const std::string value{argv[++i]};
+                if      (arg == "-o") output    = value;
+                else if (arg == "-d") directory = value;
+                else if (arg == "-a") origin    = std::stoul(value, nullptr, 0);
+                else                  jobs      = std::stoul(value);
+            }
+            else if (arg == "-l")
+                listing = true;
+            else if (arg == "-w")
+                watching = true;
+            else if (!arg.empty() && arg[0] == '-')
+                throw std::runtime_error{"usage: chip8-compiler [-o output | -d directory] [-a load-address] [-j jobs] [-l] [-w]"
+                                         " [source | directory]..."};
+            else
+            {
+                const std::vector<std::string> sources{list_sources(arg)};
+                if (sources.empty())
+                    queue.push_back({arg, {}, {}, {}});
+                for (const std::string& source : sources)
+                    queue.push_back({source, {}, {}, {}});
+            }
+        }
+        if (queue.empty())
+            queue.push_back({"res/chip8_src/chip8_program.src", "res/chip8_bin/chip8_program.bin", {}, {}});
+        if (!output.empty() && queue.size() > 1)
+            throw std::runtime_error{"-o takes one source, -d is for many"};
+        for (Job& job : queue)
+            if (job.output.empty())
+                job.output = output.empty() ? output_path(job.source, directory) : output;
+        if (watching)
+        {
+            if (queue.size() > 1)
+                throw std::runtime_error{"-w takes one source"};
+            ::watch(queue.front(), origin);
+        }
+
+        // the jobs are independent, a worker takes the next one until none is left
+        std::atomic<std::size_t> next{0};
+        auto work = [&] {
+            for (std::size_t i; (i = next++) < queue.size();)
+                ::assemble(queue[i], i, origin, listing);
+        };
+        std::vector<std::thread> workers;
+        for (unsigned i = 1; i < std::min<std::size_t>(std::max(jobs, 1u), queue.size()); ++i)
+            workers.emplace_back(work);
+        work();
+        for (std::thread& worker : workers)
+            worker.join();
+
+        int status = 0;
+        for (const Job& job : queue)
+        {
+            std::cout << job.listing;
+            if (!job.error.empty())
+            {
+                std::cerr << job.source << ": " << job.error << std::endl;
+                status = 1;
+            }
+        }
+        return status;
     }
     catch (const std::exception& ex)
     {
         std::cerr << ex.what() << std::endl;
+        return 1;
     }
-    return 0;
 }
@@ -0,0 +1,192 @@
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "batch.hpp"
+#include "input.hpp"
+#include "profile.hpp"
+
+namespace
+{
+    std::vector<unsigned char> load_binary_file(const std::string& filepath)
+    {
+        std::ifstream stream{filepath, std::ios::in | std::ios::binary};
+        if (!stream)
+            throw std::runtime_error{"file reading error: " + filepath};
+
+        stream.seekg(0, std::ios::end);
+        const auto size = stream.tellg();
+
+        stream.seekg(0, std::ios::beg);
+
+        std::vector<unsigned char> chars(size);
+        stream.read(reinterpret_cast<char*>(chars.data()), size);
+
+        return chars;
+    }
+
+    void print_result(const std::string& rom, const chip8::Batch::Result& result)
+    {
+        std::printf("%-24s %016llx PC=%03X I=%03X SP=%02X DT=%02X ST=%02X%s V=",
+                rom.c_str(), static_cast<unsigned long long>(result.display_hash),
+                result.registers.PC, result.registers.I, result.registers.SP,
+                result.registers.delay_timer, result.registers.sound_timer, result.waiting ? " wait" : "");
+        for (unsigned char v : result.registers.Vs)
+            std::printf("%02X", v);
+        std::printf("\n");
+    }
+
+    // plays a recorded session back on one machine, as fast as the engine goes
+    void replay(chip8::Interpreter& machine, const chip8::InputLog& log, const std::string& engine)
+    {
+        machine.seed(log.seed);
+        machine.set_cycles_per_tick(log.cycles_per_tick);
+
+        chip8::InputQueue input;
+        input.replay(log);
+        if      (engine == "switch")     input.run<chip8::Dispatch::switch_table>(machine, log.end_cycle);
+        else if (engine == "predecoded") input.run<chip8::Dispatch::predecoded  >(machine, log.end_cycle);
+        else if (engine == "threaded")   input.run<chip8::Dispatch::threaded    >(machine, log.end_cycle);
+        else if (engine == "jit")        input.run<chip8::Dispatch::jit         >(machine, log.end_cycle);
+        else
+            throw std::runtime_error{"unknown engine: " + engine};
+    }
+
+    // runs every ROM on the instrumented switch engine, under the session if there is one
+    void profile(const std::vector<std::string>& roms, const chip8::InputLog* log, std::uint64_t seed,
+            std::uint64_t cycles, const std::string& report_path)
+    {
+        std::ofstream report{report_path}, folded{report_path + ".folded"};
+        if (!report || !folded)
+            throw std::runtime_error{"file writing error: " + report_path};
+
+        for (const std::string& path : roms)
+        {
+            const std::vector<unsigned char> rom{::load_binary_file(path)};
+            chip8::Interpreter machine;
+            machine.copy_font(chip8::fonts::original_chip8);
+            machine.copy_rom(rom.data(), rom.size());
+
+            chip8::InputQueue input;
+            if (log)
+            {
+                machine.seed(log->seed);
+                machine.set_cycles_per_tick(log->cycles_per_tick);
+                input.replay(*log);
+                cycles = log->end_cycle;
+            }
+            else
+                machine.seed(seed);
+
+            chip8::Profiler profiler{path.substr(path.find_last_of('/') + 1)};
+            input.run_observed(machine, cycles, profiler);
+            profiler.report(report);
+            profiler.folded(folded);
+            ::print_result(path, {machine.display_hash(), machine.registers(), machine.cycles(), machine.wait()});
+        }
+    }
+
+    void run(chip8::Batch& batch, const std::string& engine, std::uint64_t cycles)
+    {
+        if      (engine == "switch")     batch.run<chip8::Dispatch::switch_table>(cycles);
+        else if (engine == "predecoded") batch.run<chip8::Dispatch::predecoded  >(cycles);
+        else if (engine == "threaded")   batch.run<chip8::Dispatch::threaded    >(cycles);
+        else if (engine == "jit")        batch.run<chip8::Dispatch::jit         >(cycles);
+        else
+            throw std::runtime_error{"unknown engine: " + engine};
+    }
+}
+
+// chip8-headless [-c cycles] [-t threads] [-s seed] [-e switch|predecoded|threaded|jit] [-r input-log] [-p report] rom...
+// with -r every ROM replays the recorded session, with its seed and length, instead of running -c cycles
+// with -p every ROM runs on the switch engine under a Profiler, writing `report` and `report`.folded;
+// -e with another engine is rejected then
+int main(int argc, char* argv[])
+{
+    try
+    {
+        std::uint64_t cycles  = 600 * 60;
+        unsigned      threads = std::thread::hardware_concurrency();
+        std::uint64_t seed    = 0;
+        std::string   engine  = "switch";
+        std::string   replay_path;
+        std::string   profile_path;
+
+        std::vector<std::string> roms;
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg{argv[i]};
+            if ((arg == "-c" || arg == "-t" || arg == "-s" || arg == "-e" || arg == "-r" || arg == "-p") && i + 1 < argc)
+            {
+                const std::string value{argv[++i]};
+                if      (arg == "-c") cycles      = std::stoull(value);
+                else if (arg == "-t") threads     = std::stoul (value);
+                else if (arg == "-s") seed        = std::stoull(value);
+                else if (arg == "-e") engine      = value;
+                else if (arg == "-r") replay_path = value;
+                else                  profile_path = value;
+            }
+            else
+                roms.push_back(arg);
+        }
+        if (roms.empty())
+            throw std::runtime_error{"usage: chip8-headless [-c cycles] [-t threads] [-s seed] [-e engine] [-r input-log] [-p report] rom..."};
+        if (!profile_path.empty() && engine != "switch")
+            throw std::runtime_error{"-p profiles on the switch engine only, not " + engine};
+
+        chip8::InputLog log;
+        if (!replay_path.empty())
+        {
+            const std::vector<unsigned char> data{::load_binary_file(replay_path)};
+            if (!log.load(data.data(), data.size()))
+                throw std::runtime_error{"not an input log: " + replay_path};
+        }
+
+        if (!profile_path.empty())
+        {
+            ::profile(roms, replay_path.empty() ? nullptr : &log, seed, cycles, profile_path);
+            return 0;
+        }
+
+        if (!replay_path.empty())
+        {
+            for (const std::string& path : roms)
+            {
+                const std::vector<unsigned char> rom{::load_binary_file(path)};
+                chip8::Interpreter machine;
+                machine.copy_font(chip8::fonts::original_chip8);
+                machine.copy_rom(rom.data(), rom.size());
+                ::replay(machine, log, engine);
+                ::print_result(path, {machine.display_hash(), machine.registers(), machine.cycles(), machine.wait()});
+            }
+            return 0;
+        }
+
+        chip8::Batch batch{threads};
+        for (const std::string& path : roms)
+        {
+            const std::vector<unsigned char> rom{::load_binary_file(path)};
+            chip8::Interpreter machine;
+            machine.copy_font(chip8::fonts::original_chip8);
+            machine.copy_rom(rom.data(), rom.size());
+            machine.seed(seed);
+            batch.add(std::move(machine));
+        }
+
+        ::run(batch, engine, cycles);
+
+        const std::vector<chip8::Batch::Result> results{batch.results()};
+        for (std::size_t i = 0; i < results.size(); ++i)
+            ::print_result(roms[i], results[i]);
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,120 @@
+#include "input.hpp"
+
+#include <cstring>
+#include <utility>
+
+namespace chip8
+{
+    namespace
+    {
+        constexpr std::size_t header_size = 4 + 2 + 2 + 4 + 8 + 8 + 4;
+
+        void put(std::vector<unsigned char>& out, std::uint64_t value, unsigned bytes)
+        {
+            for (unsigned i = 0; i < bytes; ++i)
+                out.push_back(value >> i * 8);
+        }
+
+        std::uint64_t get(const unsigned char*& in, unsigned bytes) noexcept
+        {
+            std::uint64_t value = 0;
+            for (unsigned i = 0; i < bytes; ++i)
+                value |= std::uint64_t{*in++} << i * 8;
+            return value;
+        }
+    }
+
+    std::vector<unsigned char> InputLog::save() const
+    {
+        std::vector<unsigned char> out{'C', '8', 'I', 'N'};
+        out.reserve(header_size + events.size() * 3);
+        put(out, version,         2);
+        put(out, 0,               2);
+        put(out, cycles_per_tick, 4);
+        put(out, seed,            8);
+        put(out, end_cycle,       8);
+        put(out, events.size(),   4);
+
+        std::uint64_t cycle = 0;
+        for (const InputEvent& event : events)
+        {
+            for (std::uint64_t delta = event.cycle - cycle; ; delta >>= 7)
+            {
+                out.push_back((delta & 0x7F) | (delta > 0x7F) << 7);
+                if (delta <= 0x7F)
+                    break;
+            }
+            out.push_back((event.key & 0xF) | event.down << 7);
+            cycle = event.cycle;
+        }
+        return out;
+    }
+
+    bool InputLog::load(const unsigned char* data, std::size_t size)
+    {
+        if (size < header_size || std::memcmp(data, "C8IN", 4))
+            return false;
+
+        const unsigned char* in  = data + 4;
+        const unsigned char* end = data + size;
+        if (get(in, 2) != version)
+            return false;
+        get(in, 2);
+        const unsigned      rate   = get(in, 4);
+        const std::uint64_t seed   = get(in, 8);
+        const std::uint64_t length = get(in, 8);
+        const std::uint64_t count  = get(in, 4);
+        if (!rate)
+            return false;
+
+        std::vector<InputEvent> loaded;
+        loaded.reserve(std::min<std::uint64_t>(count, size));
+        for (std::uint64_t cycle = 0; loaded.size() < count; )
+        {
+            std::uint64_t delta = 0;
+            for (unsigned shift = 0; ; shift += 7)
+            {
+                if (in == end || shift > 63)
+                    return false;
+                delta |= std::uint64_t{*in & 0x7Fu} << shift;
+                if (!(*in++ & 0x80))
+                    break;
+            }
+            if (in == end)
+                return false;
+            cycle += delta;
+            loaded.push_back({cycle, static_cast<std::uint8_t>(*in & 0xF), (*in & 0x80) != 0});
+            ++in;
+        }
+
+        cycles_per_tick = rate;
+        this->seed      = seed;
+        end_cycle       = length;
+        events          = std::move(loaded);
+        return true;
+    }
+
+    void InputQueue::push(InputEvent event)
+    {
+        if (!pending.empty())
+            event.cycle = std::max(event.cycle, pending.back().cycle);
+        pending.push_back(event);
+    }
+
+    void InputQueue::replay(const InputLog& recorded)
+    {
+        for (const InputEvent& event : recorded.events)
+            push(event);
+    }
+
+    void InputQueue::deliver(Interpreter& machine)
+    {
+        for (; !pending.empty() && pending.front().cycle <= machine.cycles(); pending.pop_front())
+        {
+            const InputEvent& event = pending.front();
+            machine.key_event(event.key, event.down);
+            if (log)
+                log->events.push_back({machine.cycles(), event.key, event.down});
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef CHIP8_INPUT_HPP
+#define CHIP8_INPUT_HPP
+
+#include "chip8.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace chip8
+{
+    struct InputEvent
+    {
+        std::uint64_t cycle;    // the slot before which the key changes
+        std::uint8_t  key;
+        bool          down;
+    };
+
+    /*
+     * A recorded session: the CXNN seed, the timer rate, the length and every key change with
+     * the slot it took effect at. Saved as a little-endian header followed by one LEB128 cycle
+     * delta and one key byte per event, so an event mostly takes two or three bytes.
+     */
+    struct InputLog
+    {
+        static constexpr std::uint16_t version = 1;
+
+        std::uint64_t seed      = 0;
+        std::uint64_t end_cycle = 0;
+        unsigned      cycles_per_tick = 10;
+
+        std::vector<InputEvent> events;
+
+        std::vector<unsigned char> save() const;
+
+        // returns false and leaves the log untouched if `data` is not a log of this version
+        bool load(const unsigned char* data, std::size_t size);
+    };
+
+    /*
+     * Key changes waiting for the virtual clock to reach their stamps. Every event is delivered
+     * right before the slot it is stamped with, or at once if that slot has passed, and appended
+     * to the attached log with the slot it actually took effect at, so running a recorded log
+     * back through a queue reproduces the session exactly.
+     */
+    class InputQueue
+    {
+        std::deque<InputEvent> pending;
+        InputLog*              log;
+
+    public:
+        explicit InputQueue(InputLog* log = nullptr) noexcept : log{log} {}
+
+        // events keep their order, a stamp earlier than the last pending one is raised to it
+        void push(InputEvent event);
+
+        // queues every event of a recorded session
+        void replay(const InputLog& recorded);
+
+        void deliver(Interpreter& machine);
+
+        std::uint64_t next_cycle() const noexcept {return pending.empty() ? UINT64_MAX : pending.front().cycle;}
+
+        // runs `cycles` slots as fast as the host allows, stopping only to deliver events
+        template<Dispatch D = Dispatch::switch_table>
+        void run(Interpreter& machine, std::uint64_t cycles)
+        {
+            const std::uint64_t end = machine.cycles() + cycles;
+            for (deliver(machine); machine.cycles() < end; deliver(machine))
+                machine.run<D>(std::min(end, next_cycle()) - machine.cycles());
+        }
+
+        // the same with Interpreter::run_observed, e.g. under a Profiler
+        template<typename Observer>
+        void run_observed(Interpreter& machine, std::uint64_t cycles, Observer& observer)
+        {
+            const std::uint64_t end = machine.cycles() + cycles;
+            for (deliver(machine); machine.cycles() < end; deliver(machine))
+                machine.run_observed(std::min(end, next_cycle()) - machine.cycles(), observer);
+        }
+    };
+}
+
+#endif
@@ -1,294 +1,26 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <fstream>
 #include <string>
-#include <queue>
 #include <stdexcept>
 #include <array>
 #include <iostream>
+#include <iterator>
+#include <sstream>
 #include <vector>
-#include <cstdlib>
-#include <unordered_map>
 #include <memory>
+#include <random>
+#include <thread>
 #include <utility>
 
 #include <SDL2/SDL.h>
 
-namespace chip8
-{
-    using Font = std::array<unsigned, 16>;
-    namespace fonts
-    {
-        constexpr Font original_chip8
-        {
-            {
-                0xF999F, 0x26227, 0xF1F8F, 0xF1F1F, 0x99F11, 0xF8F1F, 0xF8F9F, 0xF1244,
-                0xF9F9F, 0xF9F1F, 0xF9F99, 0xE9E9E, 0xF888F, 0xE999E, 0xF8F8F, 0xF8F88
-            }
-        };
-    }
-
-    class Interpreter
-    {
-        union
-        {
-            unsigned char mem[4096]{};
-            struct
-            {
-                unsigned char font[16 * 5], display[64 * 32 / 8], Vs[16], keys[16];
-                unsigned char delay_timer, sound_timer, SP, wait_key;
-                unsigned short stack[16], PC, I;
-            } interp_data;
-        };
-
-    public:
-        void copy_font(const Font& font) noexcept
-        {
-            unsigned char* fp = interp_data.font;
-            for (int i = 0; i < 16 * 5; ++i)
-                fp[i] = (font[i / 5] >> (16 - (i % 5) * 4) & 0xF) << 4;
-        }
-
-        void copy_rom(const unsigned char* rom, unsigned size, unsigned loc = 0x200) noexcept
-        {
-            std::copy_n(rom, size, mem + loc);
-            interp_data.PC = loc;
-        }
-
-        void blank_memory() noexcept {std::fill_n(mem, sizeof mem, 0);}
-
-        void update_timers() noexcept
-        {
-            if (interp_data.delay_timer > 0) --interp_data.delay_timer;
-            if (interp_data.sound_timer > 0) --interp_data.sound_timer;
-        }
-
-        void update_key(int code, bool status) noexcept {interp_data.keys[code] = status;}
-
-        void set_wait_key(int code) noexcept
-        {
-            interp_data.Vs[interp_data.wait_key] = code;
-            interp_data.wait_key = 0;
-        }
-
-        void execute_instruction() noexcept
-        {
-            const unsigned opcode = mem[interp_data.PC] << 8 | mem[interp_data.PC + 1];
-            interp_data.PC += 2;
-
-            const unsigned nnn = opcode & 0xFFF;
-            const unsigned n   = opcode & 0xF;
-            const unsigned kk  = opcode & 0xFF;
-            
-            const unsigned x = opcode >> 8  & 0xF;
-            const unsigned y = opcode >> 4  & 0xF;
-            const unsigned u = opcode >> 12 & 0xF;
-
-            switch (u)
-            {
-                case 0x0:
-                {
-                    switch (nnn)
-                    {
-                        case 0x0E0: // CLS - clear the display
-                            std::fill_n(interp_data.display, sizeof interp_data.display, 0);
-                            break;
-                        case 0x0EE: // RET - return from subroutine
-                            interp_data.PC = interp_data.stack[interp_data.SP--];
-                            break;
-                    }
-                    break;
-                }
-                case 0x1: // JP addr - jump to location nnn
-                    interp_data.PC = nnn;
-                    break;
-                case 0x2: // CALL addr - call subroutine at nnn
-                    interp_data.stack[++interp_data.SP] = interp_data.PC;
-                    interp_data.PC = nnn;
-                    break;
-                case 0x3: // SE Vx, byte - skip next instruction if Vx = kk
-                    if (interp_data.Vs[x] == kk)
-                        interp_data.PC += 2;
-                    break;
-                case 0x4: // SNE Vx, byte - skip next instruction if Vx != kk
-                    if (interp_data.Vs[x] != kk)
-                        interp_data.PC += 2;
-                    break;
-                case 0x5: // SE Vx, Vy - skip next instruction if Vx = Vy 
-                    if (!n)
-                        if (interp_data.Vs[x] == interp_data.Vs[y])
-                            interp_data.PC += 2;
-                    break;
-                case 0x6: // LD Vx, byte - set Vx = kk
-                    interp_data.Vs[x] = kk;
-                    break;
-                case 0x7: // ADD Vx, byte - set Vx = Vx + kk
-                    interp_data.Vs[x] += kk;
-                    break;
-                case 0x8:
-                {
-                    switch (n)
-                    {
-                        case 0x0: // LD Vx, Vy - set Vx = Vy
-                            interp_data.Vs[x]  = interp_data.Vs[y];
-                            break;
-                        case 0x1: // OR Vx, Vy - set Vx = Vx OR Vy
-                            interp_data.Vs[x] |= interp_data.Vs[y];
-                            break;
-                        case 0x2: // AND Vx, Vy - set Vx = Vx AND Vy
-                            interp_data.Vs[x] &= interp_data.Vs[y];
-                            break;
-                        case 0x3: // XOR Vx, Vy - set Vx = Vx XOR Vy
-                            interp_data.Vs[x] ^= interp_data.Vs[y];
-                            break;
-                        case 0x4: // ADD Vx, Vy - set Vx = Vx + Vy, set VF = carry
-                        {
-                            const unsigned temp = interp_data.Vs[x] + interp_data.Vs[y];
-                            interp_data.Vs[0xF] = temp >> 8;
-                            interp_data.Vs[  x] = temp;
-                            break;
-                        }
-                        case 0x5: // SUB Vx, Vy - set Vx - Vy, set VF = NOT borrow
-                        {
-                            const unsigned temp = interp_data.Vs[x] - interp_data.Vs[y];
-                            interp_data.Vs[0xF] = !(temp >> 8);
-                            interp_data.Vs[  x] =   temp;
-                            break;
-                        }
-                        case 0x6: // SHR Vx {, Vy} - set Vx = Vy SHR 1
-                        {
-                            interp_data.Vs[0xF] = interp_data.Vs[x] & 1; //
-                            interp_data.Vs[  x] >>= 1;                   // On the original interpreter, the value of
-                            break;                                       //
-                        }                                                // Vy is shifted. On current implementations,
-                        case 0xE: // SHL Vx {, Vy} - set Vx = Vy SHL 1   //
-                        {                                                // Y is ignored.
-                            interp_data.Vs[0xF] = interp_data.Vs[x] >> 7;//
-                            interp_data.Vs[  x] <<= 1;     /*https://en.wikipedia.org/wiki/CHIP-8#cite_note-shift-2*/
-                            break;                                       
-                        }
-                        case 0x7: // SUBN Vx, Vy - set Vx = Vy - Vx, set VF = NOT borrow
-                        {
-                            const unsigned temp = interp_data.Vs[y] - interp_data.Vs[x];
-                            interp_data.Vs[0xF] = !(temp >> 8);
-                            interp_data.Vs[  x] =   temp; 
-                            break;
-                        }
-                    }
-                    break;
-                }
-                case 0x9:
-                    if (!n) // SNE Vx, Vy - skip next instruction if Vx != Vy 
-                        if (interp_data.Vs[x] != interp_data.Vs[y])
-                            interp_data.PC += 2;
-                    break;
-                case 0xA: // LD I, addr - set I = nnn
-                    interp_data.I = nnn;
-                    break;
-                case 0xB: // JP V0, addr - jump to location nnn + V0
-                    interp_data.PC = nnn + *interp_data.Vs;
-                    break;
-                case 0xC: // RND Vx, byte - set Vx = random byte AND kk
-                    interp_data.Vs[x] = std::rand() % 256 & kk;
-                    break;
-                case 0xD: // DRW Vx, Vy nibble - display n-byte sprite starting at memory location I
-                    {     // at (Vx, Vy), set VF = collision
-                        const auto put = [this](int a, unsigned char b) noexcept {
-                            return ((interp_data.display[a] ^= b) ^ b) & b;
-                        }; 
-                        const auto px = interp_data.Vs[x];
-                        const auto py = interp_data.Vs[y];
-                        unsigned collision = 0;
-                        for(int i = n; i--;) 
-                        {
-                            collision |=
-                                put(((px    ) % 64 + (py + i) % 32 * 64) / 8, mem[(interp_data.I + i)] >> (    px % 8)) |
-                                put(((px + 8) % 64 + (py + i) % 32 * 64) / 8, mem[(interp_data.I + i)] << (8 - px % 8));
-                        }
-                        interp_data.Vs[0xF] = collision != 0;
-                    }
-                    break;
-                case 0xE:
-                {
-                    switch (kk)
-                    {
-                        case 0x9E: // SKP Vx - skip next instruction if key with the value pf Vx is pressed
-                            if (interp_data.keys[interp_data.Vs[x]])
-                                interp_data.PC += 2;
-                            break;
-                        case 0xA1: // SKNP Vx - skip next instruction if key with the value of Vx is not pressed
-                            if (!interp_data.keys[interp_data.Vs[x]])
-                                interp_data.PC += 2;
-                            break;
-                    }
-                    break;
-                }
-                case 0xF:
-                {
-                    switch (kk)
-                    {
-                        case 0x07: // LD Vx, DT - set Vx = dispaly timer value
-                            interp_data.Vs[x] = interp_data.delay_timer;
-                            break;
-                        case 0x0A: // LD Vx, K - wait for a key press, store the value of the key in Vx
-                            interp_data.wait_key = x;
-                            break;
-                        case 0x15: // LD DT, Vx - set delay timer = Vx
-                            interp_data.delay_timer = interp_data.Vs[x];
-                            break;
-                        case 0x18: // LD ST, Vx - set sound timer = Vx
-                            interp_data.sound_timer = interp_data.Vs[x];
-                            break;
-                        case 0x1E: // ADD I, Vx - set I = I + Vx
-                        {
-                            const unsigned  temp = interp_data.I + interp_data.Vs[x];
-                            interp_data.Vs[0xF] = temp >> 12;
-                            interp_data.I = temp;
-                            // VF is set to 1 when there is a range overflow (I+VX>0xFFF), and to 0 when there isn't.
-                            // This is an undocumented feature of the CHIP-8
-                            //
-                            // https://en.wikipedia.org/wiki/CHIP-8#cite_note-onlgame-3
-                            break;
-                        }
-                        case 0x29: // LD F, Vx - set I = location of sprite for digit Vx
-                            interp_data.I = interp_data.Vs[x] * 5;
-                            break;
-                        case 0x33: // LD B, Vx - store BCD representation of Vx in memory locations I, I + 1, and I + 2
-                        {
-                            mem[interp_data.I + 2] = interp_data.Vs[x]       % 10;
-                            mem[interp_data.I + 1] = interp_data.Vs[x] /  10 % 10;
-                            mem[interp_data.I    ] = interp_data.Vs[x] / 100 % 10;
-                            break;
-                        }
-                    /**/case 0x55: // LD [I], Vx - store registers V0 through Vx in memory starting at location I
-                    /**/    //std::copy_n(interp_data.Vs, x + 1, mem + interp_data.I);
-                    /**/    for (unsigned i = 0; i <= x; ++i)                
-                    /**/        mem[interp_data.I++] = interp_data.Vs[i];
-                    /**/    break;
-                    /**/case 0x65: // LD Vx, [I] - read registers V0 through Vx from memory starting at location I
-                    /**/    //std::copy_n(mem + interp_data.I, x + 1, interp_data.Vs);
-                    /**/    for (unsigned i = 0; i <= x; ++i)
-                    /**/        interp_data.Vs[i] = mem[interp_data.I++];
-                    /**/    break;
-                    /** On the original interpreter, when the operation is done, I=I+X+1.*/
-                    /** On current implementations, I is left unchanged.
-                     ** 
-                     ** https://en.wikipedia.org/wiki/CHIP-8#cite_note-memi-4
-                     **
-                     ** Old version is needed for same programs though.
-                     **
-                     **/
-                    }
-                    break;
-                }
-            }
-        }
-
-        const unsigned char* display() const noexcept {return interp_data.display;}
-
-        bool wait()  const noexcept {return interp_data.wait_key;   }
-        bool sound() const noexcept {return interp_data.sound_timer;}
-    };
-}
+#include "blit.hpp"
+#include "chip8.hpp"
+#include "input.hpp"
 
 namespace
 {
@@ -339,8 +71,6 @@ namespace
 
     class AudioDevice
     {
-        friend class AudioDeviceLocker;
-
         SDL_AudioDeviceID handle;
 
     public:
@@ -360,42 +90,422 @@ namespace
         void pause(int on) noexcept {::SDL_PauseAudioDevice(handle, on);}
     };
 
-    class AudioDeviceLocker
+    /*
+     * A fixed-capacity single-producer/single-consumer ring: the emulation thread pushes and the
+     * audio callback pops, neither ever waits for the other. Pushing into a full ring fails.
+     */
+    template<typename T, std::size_t Capacity>
+    class SpscRing
     {
-        SDL_AudioDeviceID handle;
+        static_assert(Capacity && !(Capacity & (Capacity - 1)), "the capacity must be a power of two");
+
+        T slots[Capacity];
+
+        // a cache line apart, without over-aligning the type for heap allocations
+        std::atomic<std::size_t> head{0};   // next slot to pop, advanced by the consumer
+        char padding[64 - sizeof(std::atomic<std::size_t>)];
+        std::atomic<std::size_t> tail{0};   // next slot to push, advanced by the producer
+
+    public:
+        bool push(const T& value) noexcept
+        {
+            const std::size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head.load(std::memory_order_acquire) == Capacity)
+                return false;
+            slots[t % Capacity] = value;
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(T& value) noexcept
+        {
+            const std::size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire))
+                return false;
+            value = slots[h % Capacity];
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+    };
+
+    struct ToneSegment
+    {
+        unsigned frames;    // sample frames
+        bool     on;
+    };
+
+    /*
+     * The sound timer's on/off state laid out on the sample timeline: the emulation pushes one
+     * stretch of frames per state change, the callback plays them back through a phase accumulator
+     * so the square wave stays continuous across segments and callbacks. When the ring runs dry
+     * the callback holds the last state and skips as many frames once segments arrive again; when
+     * more than `max_backlog` frames are queued it skips the excess, so the delay stays bounded.
+     */
+    struct AudioStream
+    {
+        SpscRing<ToneSegment, 256> segments;
+        std::atomic<unsigned> queued{0};    // frames pushed and not yet popped
+
+        unsigned      channels, max_backlog;
+        std::uint32_t phase_step;           // per frame, 2^32 is one period
+        Sint16        amplitude = 6000;
+
+        // owned by the callback
+        ToneSegment   current{0, false};
+        unsigned      skip = 0;
+        std::uint32_t phase = 0;
+
+        AudioStream(unsigned channels, unsigned max_backlog, double frequency, double rate) noexcept :
+            channels{channels}, max_backlog{max_backlog},
+            phase_step{static_cast<std::uint32_t>(frequency / rate * 4294967296.0)}
+        {
+        }
+
+        // counts the frames before publishing them, so the callback never subtracts them first
+        void push(ToneSegment segment) noexcept
+        {
+            if (!segment.frames)
+                return;
+            queued.fetch_add(segment.frames, std::memory_order_relaxed);
+            if (!segments.push(segment))
+                queued.fetch_sub(segment.frames, std::memory_order_relaxed);
+        }
+    };
+
+    /*
+     * Runs `slots` instruction slots one at a time, delivering the keys stamped with each slot,
+     * and pushes the sound state of every slot for its share of the sample frames at `rate`, so
+     * tone edges land on the frame of their instruction.
+     */
+    void run_slots(chip8::Interpreter& interp, std::uint64_t slots, unsigned cpu_hz, unsigned rate,
+                   AudioStream& audio, chip8::InputQueue& input)
+    {
+        const auto frame_of = [cpu_hz, rate](std::uint64_t slot) {return slot * rate / cpu_hz;};
+
+        ToneSegment segment{0, interp.sound()};
+        for (; slots; --slots)
+        {
+            const std::uint64_t slot = interp.cycles();
+            input.deliver(interp);
+            interp.run(1);
+            if (interp.sound() != segment.on)
+            {
+                audio.push(segment);
+                segment = {0, interp.sound()};
+            }
+            segment.frames += frame_of(slot + 1) - frame_of(slot);
+        }
+        audio.push(segment);
+    }
+
+    /*
+     * Paces the emulation against std::chrono::steady_clock (clock_nanosleep on Linux): slots
+     * are owed at `cpu_hz` since the start, the thread wakes `wake_hz` times a second to run
+     * them and renders at most `render_hz` times a second, 0 leaving the pace to vsync. In
+     * between it sleeps until the next wake-up or frame, whichever comes first.
+     */
+    class Scheduler
+    {
+        using Clock = std::chrono::steady_clock;
+
+        const Clock::time_point start = Clock::now();
+        Clock::time_point       next_wake = start, next_render = start;
+        const Clock::duration   wake_period, render_period;
+
+        const unsigned cpu_hz;
+        std::uint64_t  slots_run = 0, slots_dropped = 0;
+
+        std::uint64_t owed_at(Clock::time_point time) const noexcept
+        {
+            const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(time - start);
+            return elapsed.count() > 0 ? static_cast<std::uint64_t>(elapsed.count() * (cpu_hz / 1e9)) : 0;
+        }
+
+        static Clock::duration period(unsigned hz) noexcept
+        {
+            return hz ? std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds{1000000000 / hz})
+                      : Clock::duration::zero();
+        }
+
+    public:
+        Scheduler(unsigned cpu_hz, unsigned wake_hz, unsigned render_hz) noexcept :
+            wake_period{period(wake_hz)}, render_period{period(render_hz)}, cpu_hz{cpu_hz}
+        {
+        }
+
+        // slots owed since the last call, the backlog of a stall is dropped past a quarter second
+        std::uint64_t due_slots() noexcept
+        {
+            const std::uint64_t owed = owed_at(Clock::now()) - slots_dropped;
+            if (owed - slots_run > cpu_hz / 4)
+                slots_dropped += owed - slots_run - cpu_hz / 4;
+
+            const std::uint64_t slots = owed_at(Clock::now()) - slots_dropped - slots_run;
+            slots_run += slots;
+            return slots;
+        }
+
+        // the slot that falls due at `time`, the stamp for an input event that happened then
+        std::uint64_t slot_at(Clock::time_point time) const noexcept
+        {
+            const std::uint64_t owed = owed_at(time);
+            return owed - std::min(owed, slots_dropped);
+        }
+
+        bool render_due() noexcept
+        {
+            const Clock::time_point now = Clock::now();
+            if (now < next_render)
+                return false;
+            next_render = std::max(next_render + render_period, now);
+            return true;
+        }
+
+        void sleep() noexcept
+        {
+            const Clock::time_point now = Clock::now();
+            while (next_wake <= now)
+                next_wake += wake_period;
+            std::this_thread::sleep_until(render_period > Clock::duration::zero() && next_render > now
+                                          ? std::min(next_wake, next_render) : next_wake);
+        }
+    };
+
+    /*
+     * SDL scancodes to CHIP-8 keys in one dense table, -1 where nothing is bound; any number of
+     * scancodes may share a CHIP-8 key.
+     */
+    class Keymap
+    {
+        std::array<signed char, SDL_NUM_SCANCODES> keys;
 
     public:
-        explicit AudioDeviceLocker(AudioDevice& audio_device) noexcept : handle{audio_device.handle}
+        Keymap() noexcept {keys.fill(-1);}
+
+        void bind(SDL_Scancode code, int key) noexcept
+        {
+            if (code > SDL_SCANCODE_UNKNOWN && code < SDL_NUM_SCANCODES)
+                keys[code] = key & 0xF;
+        }
+
+        int operator[](SDL_Scancode code) const noexcept
+        {
+            return code >= 0 && code < SDL_NUM_SCANCODES ? keys[code] : -1;
+        }
+
+        // the digit keys and A-F for themselves, plus Z, S, Q and W for 1, 2, 7 and 8
+        static Keymap standard() noexcept
+        {
+            Keymap keymap;
+            for (int i = 0; i < 10; ++i)
+                keymap.bind(static_cast<SDL_Scancode>(SDL_SCANCODE_1 + i), (i + 1) % 10);
+            for (int i = 0; i < 6; ++i)
+                keymap.bind(static_cast<SDL_Scancode>(SDL_SCANCODE_A + i), 0xA + i);
+            keymap.bind(SDL_SCANCODE_Z, 0x1);
+            keymap.bind(SDL_SCANCODE_S, 0x2);
+            keymap.bind(SDL_SCANCODE_Q, 0x7);
+            keymap.bind(SDL_SCANCODE_W, 0x8);
+            return keymap;
+        }
+
+        /*
+         * Reads bindings of the form `<SDL scancode name> <hex key>`, one a line, `#` starting a
+         * comment, e.g. `Up 5` or `Keypad 8 5`; the name is everything before the last word and
+         * the key a hex digit 0-F.
+         */
+        static Keymap parse(const std::string& text)
         {
-            ::SDL_LockAudioDevice(handle);
+            Keymap keymap;
+            std::istringstream lines{text};
+            unsigned number = 0;
+            for (std::string line; std::getline(lines, line);)
+            {
+                ++number;
+                line = line.substr(0, line.find('#'));
+                const std::size_t last  = line.find_last_not_of(" \t\r");
+                if (last == std::string::npos)
+                    continue;
+                const std::size_t split = line.find_last_of(" \t", last);
+                const std::size_t first = line.find_first_not_of(" \t");
+                if (split == std::string::npos || split < first)
+                    throw std::runtime_error{"keymap line " + std::to_string(number) + " without a key: " + line};
+
+                const std::string name = line.substr(first, line.find_last_not_of(" \t", split) + 1 - first);
+                const SDL_Scancode code = ::SDL_GetScancodeFromName(name.c_str());
+                if (code == SDL_SCANCODE_UNKNOWN)
+                    throw std::runtime_error{"unknown key name on keymap line " + std::to_string(number) + ": " + name};
+
+                // one hex digit, leading zeros aside
+                const std::string key   = line.substr(split + 1, last - split);
+                const std::size_t digit = key.find_first_not_of('0');
+                if (key.find_first_not_of("0123456789ABCDEFabcdef") != std::string::npos
+                        || (digit != std::string::npos && digit + 1 != key.size()))
+                    throw std::runtime_error{"keymap line " + std::to_string(number) + " binds " + key
+                            + ", not a key 0-F: " + line};
+                keymap.bind(code, digit == std::string::npos ? 0 : std::stoi(key.substr(digit), nullptr, 16));
+            }
+            return keymap;
         }
+    };
+
+    struct KeyEvent
+    {
+        int  key;
+        bool down;
+        std::chrono::steady_clock::time_point time;
+    };
 
-        AudioDeviceLocker           (const AudioDeviceLocker&) = delete;
-        AudioDeviceLocker& operator=(const AudioDeviceLocker&) = delete;
+    /*
+     * Three slots handed between one writer and one reader without locks: the writer fills
+     * its back slot and swaps it with the shared middle one, the reader swaps its front slot
+     * with the middle one when that holds an unread write. Neither ever waits, and the reader
+     * always gets the latest complete write.
+     */
+    template<typename T>
+    class TripleBuffer
+    {
+        T slots[3]{};
+
+        std::atomic<unsigned> middle{1};    // the shared slot, plus `fresh` while it holds an unread write
+        unsigned back = 0, front = 2;       // owned by the writer and the reader
+
+        static constexpr unsigned fresh = 4;
+
+    public:
+        T& back_slot() noexcept {return slots[back];}
+
+        void publish() noexcept {back = middle.exchange(back | fresh, std::memory_order_acq_rel) & 3;}
+
+        // switches to the latest write, returns false if nothing was published since the last call
+        bool update() noexcept
+        {
+            if (!(middle.load(std::memory_order_relaxed) & fresh))
+                return false;
+            front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+            return true;
+        }
 
-        ~AudioDeviceLocker() {::SDL_UnlockAudioDevice(handle);}
+        const T& front_slot() const noexcept {return slots[front];}
     };
 
-    void blit_chip8_display(const chip8::Interpreter& interp, Uint32* buffer) noexcept
+    using Frame = std::array<unsigned char, 64 * 32 / 8>;
+
+    /*
+     * Runs the interpreter on a thread of its own at the scheduler's pace. Keys come in through
+     * an SPSC ring into the input queue and every changed display goes out through a triple
+     * buffer, so a slow present on the main thread never holds the emulation back.
+     */
+    class EmulationThread
     {
-        const unsigned char* const display = interp.display();
-        for (int i = 0; i < 64 * 32; ++i)
-            buffer[i] = 0xFFFFFFFF * (display[i / 8] >> (7 - i % 8) & 1);
+        chip8::Interpreter&      interp;
+        chip8::InputQueue&       input;
+        SpscRing<KeyEvent, 256>  keys;
+        TripleBuffer<Frame>      frames;
+        std::atomic<bool>        stopping{false};
+        std::thread              thread;
+
+        void run(unsigned cpu_hz, unsigned wake_hz, unsigned rate, AudioStream& audio)
+        {
+            for (Scheduler scheduler{cpu_hz, wake_hz, 0}; !stopping.load(std::memory_order_relaxed); scheduler.sleep())
+            {
+                for (KeyEvent event; keys.pop(event);)
+                    input.push({scheduler.slot_at(event.time), static_cast<std::uint8_t>(event.key), event.down});
+
+                ::run_slots(interp, scheduler.due_slots(), cpu_hz, rate, audio, input);
+
+                if (interp.take_changed_rows())
+                {
+                    std::copy_n(interp.display(), frames.back_slot().size(), frames.back_slot().begin());
+                    frames.publish();
+                }
+            }
+        }
+
+    public:
+        EmulationThread(chip8::Interpreter& interp, chip8::InputQueue& input,
+                        unsigned cpu_hz, unsigned wake_hz, unsigned rate, AudioStream& audio) :
+            interp{interp}, input{input}, thread{&EmulationThread::run, this, cpu_hz, wake_hz, rate, std::ref(audio)}
+        {
+        }
+
+        ~EmulationThread()
+        {
+            stopping = true;
+            thread.join();
+        }
+
+        EmulationThread           (const EmulationThread&) = delete;
+        EmulationThread& operator=(const EmulationThread&) = delete;
+
+        void push_key(KeyEvent event) noexcept {keys.push(event);}
+
+        // copies the latest frame into `shown` and returns the rows it changed there
+        std::uint32_t take_frame(Frame& shown) noexcept
+        {
+            std::uint32_t changed = 0;
+            if (frames.update())
+            {
+                const Frame& frame = frames.front_slot();
+                for (unsigned row = 0; row < 32; ++row)
+                    if (!std::equal(frame.begin() + row * 8, frame.begin() + row * 8 + 8, shown.begin() + row * 8))
+                        changed |= 1u << row;
+                shown = frame;
+            }
+            return changed;
+        }
+    };
+
+    // uploads each run of `changed` rows as one sub-rect through `pixels`, returns false if no row changed
+    bool update_chip8_texture(SDL_Texture* texture, const unsigned char* display, std::uint32_t changed,
+                              int scale, std::uint32_t* pixels) noexcept
+    {
+        if (!changed)
+            return false;
+
+        for (int row = 0; changed; )
+        {
+            for (; !(changed & 1); changed >>= 1)
+                ++row;
+            int rows = 0;
+            for (; changed & 1; changed >>= 1)
+                ++rows;
+
+            const SDL_Rect rect{0, row * scale, 64 * scale, rows * scale};
+            chip8::blit_display(display, row, rows, scale, pixels, 64 * scale);
+            ::SDL_UpdateTexture(texture, &rect, pixels, 64 * scale * sizeof(std::uint32_t));
+            row += rows;
+        }
+        return true;
     }
 
     void audio_callback(void* userdata, Uint8* stream, int len) noexcept
     {
-        const auto audio_queue = static_cast<std::queue<unsigned>*>(userdata);
-        if (audio_queue->empty())
-            std::fill_n(stream, len, 0);
-        else
+        const auto audio = static_cast<AudioStream*>(userdata);
+
+        const unsigned backlog = audio->queued.load(std::memory_order_relaxed);
+        if (backlog > audio->max_backlog + audio->skip)
+            audio->skip = backlog - audio->max_backlog;
+
+        auto target = reinterpret_cast<Sint16*>(stream);
+        for (int frames = len / (sizeof *target * audio->channels); frames--; target += audio->channels)
         {
-            auto target = reinterpret_cast<Sint16*>(stream);
-            for (; len && audio_queue->front(); len -= 4, target += 2, --audio_queue->front())
-                target[0] = target[1] = 300 * ((len & 256) - 64);
-            for (; len; len -= 4, target += 2)
-                target[0] = target[1] = 0;
-            if (!audio_queue->front()) audio_queue->pop();
+            while (!audio->current.frames && audio->segments.pop(audio->current))
+            {
+                audio->queued.fetch_sub(audio->current.frames, std::memory_order_relaxed);
+                const unsigned skipped = std::min(audio->skip, audio->current.frames);
+                audio->current.frames -= skipped;
+                audio->skip           -= skipped;
+            }
+            if (audio->current.frames)
+                --audio->current.frames;
+            else if (audio->skip < audio->max_backlog)
+                ++audio->skip;  // ran dry, the last state holds until the emulation catches up
+            else
+                audio->current.on = false;
+
+            const Sint16 sample = audio->current.on ? (audio->phase >> 31 ? -audio->amplitude : audio->amplitude) : 0;
+            audio->phase += audio->phase_step;
+            std::fill_n(target, audio->channels, sample);
         }
     }
 
@@ -427,6 +537,22 @@ namespace
         return {object_struct.handle, object_struct.pdestructor};
     }
 
+    void write_binary_file(const std::string& filepath, const std::vector<unsigned char>& data)
+    {
+        std::ofstream stream{filepath, std::ios::out | std::ios::binary};
+        if (!stream)
+            throw std::runtime_error{"it is failed to write a file: " + filepath};
+        stream.write(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+
+    std::string read_text_file(const std::string& filepath)
+    {
+        std::ifstream stream{filepath};
+        if (!stream)
+            throw std::runtime_error{"there is no such a file " + filepath};
+        return {std::istreambuf_iterator<char>{stream}, std::istreambuf_iterator<char>{}};
+    }
+
     std::vector<unsigned char> load_binary_file(const std::string& filepath)
     {
         std::ifstream stream{filepath, std::ios::in | std::ios::binary};
@@ -445,8 +571,70 @@ namespace
     }
 }
 
-int main()
+// chip8-interpreter [--cpu-hz hz] [--timer-hz hz] [--render-hz hz|0 for vsync] [--low-latency-audio]
+//                   [--emulation-thread] [--seed n] [--record input-log] [--keymap file]
+int main(int argc, char* argv[])
 {
+    unsigned cpu_hz            = 600;
+    unsigned timer_hz          = 60;
+    unsigned render_hz         = 60;
+    unsigned cycles_per_frame  = 0; // instructions per timer tick, overrides --cpu-hz when given
+    bool     low_latency_audio = false;
+    bool     emulation_thread  = false;
+
+    std::uint64_t seed = std::random_device{}();
+    std::string   record_path, keymap_path;
+    std::string   rom_path = "res/chip8_bin/chip8_program.bin";
+    unsigned      load_address = 0x200;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg{argv[i]};
+        if ((arg == "--cpu-hz" || arg == "--timer-hz" || arg == "--render-hz" || arg == "--cycles-per-frame"
+                    || arg == "--load-address") && i + 1 < argc)
+        {
+            const unsigned value = std::stoul(argv[++i], nullptr, 0);
+            if      (arg == "--cpu-hz")           cpu_hz           = std::max(value, 1u);
+            else if (arg == "--timer-hz")         timer_hz         = std::max(value, 1u);
+            else if (arg == "--render-hz")        render_hz        = value;
+            else if (arg == "--cycles-per-frame") cycles_per_frame = std::max(value, 1u);
+            else                                  load_address     = value;
+        }
+        else if (arg == "--low-latency-audio")
+            low_latency_audio = true;
+        else if (arg == "--emulation-thread")
+            emulation_thread = true;
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = std::stoull(argv[++i]);
+        else if (arg == "--record" && i + 1 < argc)
+            record_path = argv[++i];
+        else if (arg == "--keymap" && i + 1 < argc)
+            keymap_path = argv[++i];
+        else if (arg.compare(0, 2, "--"))
+            rom_path = arg;
+        else
+        {
+            std::cerr << "usage: chip8-interpreter [--cpu-hz hz | --cycles-per-frame n] [--timer-hz hz] [--render-hz hz]"
+                         " [--load-address addr] [--low-latency-audio] [--emulation-thread] [--seed n]"
+                         " [--record input-log] [--keymap file] [rom]" << std::endl;
+            return 1;
+        }
+    }
+    if (cycles_per_frame)
+        cpu_hz = cycles_per_frame * timer_hz;
+
+    // the core ticks the timers every whole number of slots, so unless --cpu-hz is a multiple of
+    // --timer-hz they run at cpu_hz / cycles_per_tick instead, up to half a slot per tick off (600/70: 66.7 Hz)
+    const unsigned cycles_per_tick = std::max((cpu_hz + timer_hz / 2) / timer_hz, 1u);
+    if (cpu_hz % timer_hz)
+        std::cerr << "the timers tick every " << cycles_per_tick << " instructions, at "
+                  << static_cast<double>(cpu_hz) / cycles_per_tick << " Hz" << std::endl;
+    if (load_address < 0x200 || load_address >= 0x1000)
+    {
+        std::cerr << "the load address must be within 0x200-0xFFF" << std::endl;
+        return 1;
+    }
+
     if (::SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) >= 0)
     {
         constexpr int WINDOW_WIDTH  = 320;
@@ -458,52 +646,77 @@ int main()
                         SDL_WINDOWPOS_CENTERED,
                         SDL_WINDOWPOS_CENTERED, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_RESIZABLE);
             
-            const auto renderer = ::create_SDL_object<SDL_Renderer>(window.get(), -1, SDL_RENDERER_ACCELERATED);
+            // prefers an accelerated renderer and falls back to the software one
+            const auto renderer =
+                ::create_SDL_object<SDL_Renderer>(window.get(), -1, render_hz ? 0 : SDL_RENDERER_PRESENTVSYNC);
+
+            // a software renderer gets the display pre-scaled to the largest whole multiple that fits
+            // the window and copied 1:1 into the middle of it, as stretching costs it a pass per frame
+            SDL_RendererInfo renderer_info;
+            ::SDL_GetRendererInfo(renderer.get(), &renderer_info);
+            const bool software_renderer = renderer_info.flags & SDL_RENDERER_SOFTWARE;
+
+            int texture_scale = 0;
+            std::unique_ptr<SDL_Texture, void(*)(SDL_Texture*)> texture{nullptr, ::SDL_DestroyTexture};
+            std::vector<std::uint32_t> texture_pixels;
+            SDL_Rect texture_rect{};
+
+            // the low-latency mode trades stereo and a 1024-frame buffer for mono and 256 frames
+            const Uint8  audio_channels = low_latency_audio ? 1 : 2;
+            const Uint16 audio_samples  = low_latency_audio ? 256 : 1024;
 
-            const auto texture =
-                ::create_SDL_object<SDL_Texture>(renderer.get(),
-                        SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, 64, 32);
+            // low-latency audio wakes the emulation often enough to keep about one buffer queued
+            const unsigned wake_hz = std::max(timer_hz, low_latency_audio ? 44100u / audio_samples : 0u);
 
-            std::queue<unsigned> audio_queue;
+            // a wake-up pushes up to 1/wake_hz of audio at once, the callback keeps that and one buffer
+            AudioStream audio_stream{audio_channels, audio_samples + 44100 / wake_hz, 44100.0 / 128, 44100};
 
-            const SDL_AudioSpec audio_spec{::make_audio_spec(44100, AUDIO_S16SYS, 2, 4096, ::audio_callback, &audio_queue)};
+            const SDL_AudioSpec audio_spec{::make_audio_spec(44100, AUDIO_S16SYS, audio_channels, audio_samples,
+                    ::audio_callback, &audio_stream)};
 
             AudioDevice audio_device{audio_spec};
             audio_device.pause(0);
 
             chip8::Interpreter chip8_interpreter;
+            chip8_interpreter.set_cycles_per_tick(cycles_per_tick);
+            chip8_interpreter.seed(seed);
             chip8_interpreter.copy_font(chip8::fonts::original_chip8);
             {
-                std::vector<unsigned char> rom{::load_binary_file("res/chip8_bin/chip8_program.bin")};
-                chip8_interpreter.copy_rom(rom.data(), rom.size());
+                std::vector<unsigned char> rom{::load_binary_file(rom_path)};
+                if (rom.size() > 0x1000 - load_address)
+                    throw std::runtime_error{"the ROM does not fit in memory: " + rom_path};
+                chip8_interpreter.copy_rom(rom.data(), rom.size(), load_address);
             }
 
-            std::unordered_map<int, int> keys_map
-            {
-                {SDL_SCANCODE_Z, 0x1}, {SDL_SCANCODE_S, 0x2}, {SDL_SCANCODE_C, 0x3}, {SDL_SCANCODE_C, 0xC},
-                {SDL_SCANCODE_A, 0x4}, {SDL_SCANCODE_F, 0x5}, {SDL_SCANCODE_D, 0x6}, {SDL_SCANCODE_D, 0xD},
-                {SDL_SCANCODE_Q, 0x7}, {SDL_SCANCODE_W, 0x8}, {SDL_SCANCODE_E, 0x9}, {SDL_SCANCODE_E, 0xE},
-                {SDL_SCANCODE_A, 0xA}, {SDL_SCANCODE_0, 0x0}, {SDL_SCANCODE_F, 0xB}, {SDL_SCANCODE_F, 0xF}
-            };
+            const Keymap keymap = keymap_path.empty() ? Keymap::standard() : Keymap::parse(::read_text_file(keymap_path));
 
-            for (int i = 0; i < 10; ++i)
-                keys_map.insert({SDL_SCANCODE_1 + i, (i + 1) % 10});
-            
-            constexpr unsigned seconds_per_update = 1000 / 60, insts_per_update = 10;
+            SDL_Event event;
 
-            unsigned acc_update_time = 0;
+            bool redraw = true; // the window needs presenting even if the display did not change
 
-            SDL_Event event;
+            // with an emulation thread this one only handles events and presents, at the render rate
+            Scheduler scheduler{cpu_hz, emulation_thread ? (render_hz ? render_hz : 60) : wake_hz, render_hz};
 
-            Uint32 previous_time = ::SDL_GetTicks();
+            chip8::InputLog   input_log;
+            chip8::InputQueue input{record_path.empty() ? nullptr : &input_log};
 
-            for (bool running = true; running;)
-            {
-                const Uint32      start_time = ::SDL_GetTicks();
-                acc_update_time += start_time - previous_time;
-                
-                previous_time = start_time;
+            std::unique_ptr<EmulationThread> emulation;
+            if (emulation_thread)
+                emulation.reset(new EmulationThread{chip8_interpreter, input, cpu_hz, wake_hz,
+                        static_cast<unsigned>(audio_spec.freq), audio_stream});
+
+            // SDL stamps events in milliseconds since its initialisation
+            const auto sdl_epoch = std::chrono::steady_clock::now() - std::chrono::milliseconds{::SDL_GetTicks()};
+
+            Frame shown{};
 
+            // rows the texture holds nothing defined for, all of them until the first upload and after a reset
+            std::uint32_t stale_rows = ~0u;
+
+            bool resized = true; // the texture is (re)made to the window's size before the next upload
+
+            for (bool running = true; running; scheduler.sleep())
+            {
                 while (::SDL_PollEvent(&event))
                 {
                     switch (event.type)
@@ -511,48 +724,87 @@ int main()
                         case SDL_QUIT:
                             running = false;
                             break;
+                        case SDL_WINDOWEVENT:
+                            if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                                resized = true;
+                            redraw = true;
+                            break;
+                        case SDL_RENDER_TARGETS_RESET:
+                        case SDL_RENDER_DEVICE_RESET:
+                            stale_rows = ~0u;
+                            break;
                         case SDL_KEYDOWN:
                             if (event.key.keysym.scancode == SDL_SCANCODE_ESCAPE)
                                 running = false;
                         case SDL_KEYUP:
                         {
-                            const auto key_iter = keys_map.find(event.key.keysym.scancode);
-                            if (key_iter != keys_map.cend())
+                            const int key = keymap[event.key.keysym.scancode];
+                            if (key >= 0)
                             {
-                                chip8_interpreter.update_key(key_iter->second, event.type == SDL_KEYDOWN);
-                                if (chip8_interpreter.wait() && event.type == SDL_KEYDOWN)
-                                    chip8_interpreter.set_wait_key(key_iter->second);
+                                const KeyEvent key_event{key, event.type == SDL_KEYDOWN,
+                                        sdl_epoch + std::chrono::milliseconds{event.key.timestamp}};
+                                if (emulation)
+                                    emulation->push_key(key_event);
+                                else
+                                    input.push({scheduler.slot_at(key_event.time),
+                                                static_cast<std::uint8_t>(key_event.key), key_event.down});
                             }
                             break;
                         }
                     }
                 }
 
-                for (; acc_update_time >= seconds_per_update; acc_update_time -= seconds_per_update)
-                {
-                    for (unsigned i = 0; i < insts_per_update && !chip8_interpreter.wait(); ++i)
-                        chip8_interpreter.execute_instruction();
+                if (!emulation)
+                    ::run_slots(chip8_interpreter, scheduler.due_slots(), cpu_hz, audio_spec.freq, audio_stream, input);
 
-                    if (chip8_interpreter.sound())
+                if (!scheduler.render_due())
+                    continue;
+
+                if (resized)
+                {
+                    resized = false;
+                    int width = WINDOW_WIDTH, height = WINDOW_HEIGHT;
+                    ::SDL_GetRendererOutputSize(renderer.get(), &width, &height);
+                    const int scale = software_renderer ?
+                            std::max(1, std::min({width / 64, height / 32, static_cast<int>(chip8::max_blit_scale)})) : 1;
+                    if (scale != texture_scale)
                     {
-                        const AudioDeviceLocker locker{audio_device};
-                        audio_queue.push(30 * audio_spec.freq / 1000);
+                        texture = ::create_SDL_object<SDL_Texture>(renderer.get(),
+                                SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, 64 * scale, 32 * scale);
+                        texture_pixels.resize(64 * scale * 32 * scale);
+                        texture_scale = scale;
+                        stale_rows    = ~0u;
                     }
-
-                    chip8_interpreter.update_timers();
+                    texture_rect = {(width - 64 * scale) / 2, (height - 32 * scale) / 2, 64 * scale, 32 * scale};
                 }
 
-                Uint32* pixels;
-                int pitch;
+                const std::uint32_t rows = stale_rows |
+                        (emulation ? emulation->take_frame(shown) : chip8_interpreter.take_changed_rows());
+                stale_rows = 0;
+                const bool changed = ::update_chip8_texture(texture.get(), emulation ? shown.data() : chip8_interpreter.display(),
+                        rows, texture_scale, texture_pixels.data());
+                if (changed || redraw)
+                {
+                    if (software_renderer)
+                    {
+                        ::SDL_RenderClear(renderer.get());
+                        ::SDL_RenderCopy(renderer.get(), texture.get(), nullptr, &texture_rect);
+                    }
+                    else
+                        ::SDL_RenderCopy(renderer.get(), texture.get(), nullptr, nullptr);
 
-                ::SDL_LockTexture(texture.get(), nullptr, reinterpret_cast<void**>(&pixels), &pitch);
-                ::blit_chip8_display(chip8_interpreter, pixels);
-                
-                ::SDL_UnlockTexture(texture.get());
+                    ::SDL_RenderPresent(renderer.get());
+                    redraw = false;
+                }
+            }
 
-                ::SDL_RenderCopy(renderer.get(), texture.get(), nullptr, nullptr);
-                
-                ::SDL_RenderPresent(renderer.get());
+            emulation.reset();
+            if (!record_path.empty())
+            {
+                input_log.seed            = seed;
+                input_log.cycles_per_tick = cycles_per_tick;
+                input_log.end_cycle       = chip8_interpreter.cycles();
+                ::write_binary_file(record_path, input_log.save());
             }
         }
         catch (const std::exception& ex)
@@ -0,0 +1,661 @@
+#include "chip8.hpp"
+
+#if defined(__x86_64__) && defined(__linux__) && !defined(CHIP8_NO_JIT)
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <bitset>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <new>
+#include <vector>
+
+namespace chip8
+{
+    /*
+     * Translates straight-line runs of CHIP-8 opcodes into x86-64 code held in an mmap'd cache.
+     * A block ends with the first branch (1NNN, 2NNN, 00EE, BNNN, a skip), with FX0A, or with a
+     * memory store (FX33, FX55) so that a block never executes bytes it has just overwritten.
+     *
+     * Generated code keeps rbx = mem, r12 = the interpreter, and works on the machine state in
+     * memory; sprites, BCD, register stores and loads, CLS and RND call back into the interpreter.
+     * PC is written at block exits and before every RET and helper call, the points where an
+     * overflowed stack or I can reach its bytes, so those see it as execute_instruction leaves it.
+     *
+     * Blocks run chained inside one call of the enter stub, which also keeps r13 = the slots left
+     * to run, r14 = the slots left before the next timer tick, rbp = cycles_per_tick and r15 = the
+     * block table. A block checks that it fits the slots left, leaving through the miss stub
+     * otherwise, then fires the ticks due; DT/ST are only read or written by a block's first
+     * instruction, so no block needs to fit the tick. A jump or skip to a constant address leaves
+     * through a jump that the first return to C++ patches to go to the target's block, RET and
+     * JP V0 look their target up in the block table inline. Only a miss, a key wait (FX0A), a
+     * store to memory (FX33, FX55) or a CALL pushing into the program area returns to C++. A block start rewritten max_drops times (a
+     * program patching its own operands) is left to the interpreter from then on.
+     */
+    class JitCache
+    {
+        using Helper = void (*)(Interpreter* interp, unsigned a, unsigned b, unsigned c);
+
+        struct Block
+        {
+            const unsigned char* code;        // the entry, first for the inline lookup
+            std::uint16_t        start, end;  // translated bytes [start, end)
+            std::uint16_t        length;      // instructions, each one takes one slot
+        };
+
+        static_assert(sizeof(Block) == 16, "the inline lookup reads a block's entry at [r15 + PC * 16]");
+
+        // a patched exit: the jump at `site` goes to the block at `target` instead of out
+        struct Link
+        {
+            unsigned char* site;
+            std::uint16_t  target;
+        };
+
+        enum Reg {eax, ecx, edx};
+
+        enum class BlockEnd {open, closed, branched};
+
+        static constexpr std::size_t code_capacity    = 256 * 1024;
+        static constexpr unsigned    max_block_length = 64;
+        static constexpr std::size_t max_block_bytes  = max_block_length * 48 + 256;
+
+        unsigned char* const code;
+        std::size_t          code_size = 0, stubs_size = 0;
+        unsigned char*       out       = nullptr;
+        unsigned             flushes   = 0;
+
+        // at the start of the code: enter, leave (rax = the exit jump to link or 0), leave with 0, tick
+        const unsigned char* enter_stub = nullptr;
+        const unsigned char* exit_stub  = nullptr;
+        const unsigned char* miss_stub  = nullptr;
+        const unsigned char* tick_stub  = nullptr;
+
+        static constexpr unsigned max_drops = 4; // a block rewritten more often than that is left to the interpreter
+
+        Block                      blocks[4096]{};  // by start, odd ones included
+        std::uint8_t               drops[4096]{};
+        std::vector<std::uint16_t> live;
+        std::vector<Link>          links;
+        std::bitset<4096>          translated; // the bytes live blocks were translated from
+
+        void mark_translated(const Block& block) noexcept
+        {
+            for (unsigned addr = block.start; addr < block.end; ++addr)
+                translated.set(addr);
+        }
+
+        struct
+        {
+            std::uint32_t Vs, keys, delay_timer, sound_timer, SP, wait_key, stack, PC, I;
+        } off;
+
+        unsigned first_code_level; // the first SP whose stack slot lies at 0x200 or above
+
+        void emit(std::initializer_list<unsigned char> bytes) noexcept
+        {
+            out = std::copy(bytes.begin(), bytes.end(), out);
+        }
+
+        void emit16(std::uint16_t value) noexcept {emit({static_cast<unsigned char>(value), static_cast<unsigned char>(value >> 8)});}
+        void emit32(std::uint32_t value) noexcept {emit16(value); emit16(value >> 16);}
+        void emit64(std::uint64_t value) noexcept {emit32(value); emit32(value >> 32);}
+
+        // the rel32 operand ending an instruction, to `target`
+        void emit_rel32(const unsigned char* target) noexcept {emit32(target - (out + 4));}
+
+        // points the jmp rel32 at `site` to `target`
+        static void patch_jump(unsigned char* site, const unsigned char* target) noexcept
+        {
+            const std::int32_t rel = target - (site + 5);
+            std::memcpy(site + 1, &rel, sizeof rel);
+        }
+
+        // all the state lives below 0x200, addressed as [rbx + disp32]
+        void modrm_rbx(Reg reg, std::uint32_t disp) noexcept {emit({static_cast<unsigned char>(0x83 | reg << 3)}); emit32(disp);}
+
+        void load_byte (Reg reg, std::uint32_t disp) noexcept {emit({0x0F, 0xB6}); modrm_rbx(reg, disp);}  // movzx r32, byte
+        void load_word (Reg reg, std::uint32_t disp) noexcept {emit({0x0F, 0xB7}); modrm_rbx(reg, disp);}  // movzx r32, word
+        void store_byte(std::uint32_t disp, Reg reg) noexcept {emit({      0x88}); modrm_rbx(reg, disp);}  // mov byte, r8
+        void store_word(std::uint32_t disp, Reg reg) noexcept {emit({0x66, 0x89}); modrm_rbx(reg, disp);}  // mov word, r16
+
+        void store_byte_imm(std::uint32_t disp, unsigned char value) noexcept
+        {
+            emit({0xC6}); modrm_rbx(eax, disp); emit({value});
+        }
+
+        void store_word_imm(std::uint32_t disp, std::uint16_t value) noexcept
+        {
+            emit({0x66, 0xC7}); modrm_rbx(eax, disp); emit16(value);
+        }
+
+        // PC = next, as the helper may read or write it through I, then the call
+        void call(Helper helper, unsigned next, unsigned a, unsigned b = 0, unsigned c = 0) noexcept
+        {
+            store_word_imm(off.PC, next);
+            emit({0x4C, 0x89, 0xE7});                               // mov rdi, r12
+            emit({0xBE}); emit32(a);                                // mov esi, a
+            emit({0xBA}); emit32(b);                                // mov edx, b
+            emit({0xB9}); emit32(c);                                // mov ecx, c
+            emit({0x48, 0xB8}); emit64(reinterpret_cast<std::uintptr_t>(helper));
+            emit({0xFF, 0xD0});                                     // call rax
+        }
+
+        // PC = target, then out through a trampoline handing the jump over to be linked to the target
+        void exit_to(unsigned target) noexcept
+        {
+            store_word_imm(off.PC, target);
+            emit({0xE9}); emit32(0);                                // jmp trampoline
+            emit({0x48, 0x8D, 0x05}); emit32(-12);                  // lea rax, [the jmp]
+            emit({0xE9}); emit_rel32(exit_stub);
+        }
+
+        // on to the block at PC if there is one, out through the miss stub otherwise
+        void exit_indirect() noexcept
+        {
+            load_word(eax, off.PC);
+            emit({0x8D, 0x88}); emit32(-0x200);                     // lea ecx, [rax - 0x200]
+            emit({0x81, 0xF9}); emit32(0xFFE - 0x200);              // cmp ecx, 0xDFE
+            emit({0x0F, 0x87}); emit_rel32(miss_stub);              // ja miss
+            emit({0xC1, 0xE0, 0x04});                               // shl eax, 4
+            emit({0x49, 0x8B, 0x04, 0x07});                         // mov rax, [r15 + rax]
+            emit({0x48, 0x85, 0xC0});                               // test rax, rax
+            emit({0x0F, 0x84}); emit_rel32(miss_stub);              // jz miss
+            emit({0xFF, 0xE0});                                     // jmp rax
+        }
+
+        // on to next, or to next + 2 unless the flags give `jcc_no_skip`
+        void skip_unless(unsigned char jcc_no_skip, unsigned next) noexcept
+        {
+            emit({jcc_no_skip, 0});
+            unsigned char* const skip = out;
+            exit_to(next + 2);
+            skip[-1] = out - skip;
+            exit_to(next);
+        }
+
+        void emit_stubs() noexcept;
+
+        static void cls(Interpreter* interp, unsigned, unsigned, unsigned) noexcept
+        {
+            interp->clear_display();
+        }
+
+        static void rnd(Interpreter* interp, unsigned x, unsigned kk, unsigned) noexcept
+        {
+            interp->interp_data.Vs[x] = interp->random_byte() & kk;
+        }
+
+        static void drw(Interpreter* interp, unsigned x, unsigned y, unsigned n) noexcept {interp->draw_sprite(x, y, n);}
+
+        static void stack_written(Interpreter* interp, unsigned, unsigned, unsigned) noexcept {interp->invalidate_stack_top();}
+
+        static void bcd  (Interpreter* interp, unsigned x, unsigned, unsigned) noexcept {interp->store_bcd(x);      }
+        static void store(Interpreter* interp, unsigned x, unsigned, unsigned) noexcept {interp->store_registers(x);}
+        static void load (Interpreter* interp, unsigned x, unsigned, unsigned) noexcept {interp->load_registers(x); }
+
+        BlockEnd translate_instruction(unsigned opcode, unsigned next, bool& timer_access) noexcept;
+
+        const Block* translate(const Interpreter& interp, unsigned start) noexcept;
+
+    public:
+        explicit JitCache(const Interpreter& interp) noexcept :
+            code{static_cast<unsigned char*>(::mmap(nullptr, code_capacity,
+                        PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0))}
+        {
+            const auto offset = [&interp](const void* p) noexcept -> std::uint32_t {
+                return static_cast<const unsigned char*>(p) - interp.mem;
+            };
+            off.Vs          = offset(interp.interp_data.Vs);
+            off.keys        = offset(interp.interp_data.keys);
+            off.delay_timer = offset(&interp.interp_data.delay_timer);
+            off.sound_timer = offset(&interp.interp_data.sound_timer);
+            off.SP          = offset(&interp.interp_data.SP);
+            off.wait_key    = offset(&interp.interp_data.wait_key);
+            off.stack       = offset(interp.interp_data.stack);
+            off.PC          = offset(&interp.interp_data.PC);
+            off.I           = offset(&interp.interp_data.I);
+            first_code_level = (0x200 - off.stack + 1) / 2;
+            if (usable())
+                emit_stubs();
+        }
+
+        ~JitCache() {if (usable()) ::munmap(code, code_capacity);}
+
+        JitCache           (const JitCache&) = delete;
+        JitCache& operator=(const JitCache&) = delete;
+
+        bool usable() const noexcept {return code != MAP_FAILED;}
+
+        // the registers of a run, in and out: slots to run, slots before the next tick, the tick period
+        struct State
+        {
+            std::uint64_t cycles;
+            std::int64_t  tick_left;
+            std::uint64_t cycles_per_tick;
+        };
+
+        // runs blocks chained from `block`, returns the exit jump to link to the block at PC, or null
+        unsigned char* run(Interpreter& interp, const Block& block, State& state) noexcept
+        {
+            using Enter = unsigned char* (*)(unsigned char* mem, Interpreter* interp, const unsigned char* entry, State* state);
+            return reinterpret_cast<Enter>(const_cast<unsigned char*>(enter_stub))(interp.mem, &interp, block.code, &state);
+        }
+
+        // points the exit jump at `site` to the block at PC, translating it if need be
+        void link(const Interpreter& interp, unsigned char* site) noexcept
+        {
+            const unsigned flushed = flushes;
+            const Block* const target = lookup(interp, interp.interp_data.PC);
+            if (!target || flushes != flushed) // a flush took the jump's own block
+                return;
+            patch_jump(site, target->code);
+            links.push_back({site, target->start});
+        }
+
+        const Block* lookup(const Interpreter& interp, unsigned pc) noexcept
+        {
+            if (pc < 0x200 || pc > 0xFFE || drops[pc] >= max_drops) // the interpreter area changes behind the cache's back
+                return nullptr;
+            const Block& block = blocks[pc];
+            return block.code ? &block : translate(interp, pc);
+        }
+
+        // drops every block that translated a byte in [lo, hi] and unlinks the jumps into them
+        void invalidate(unsigned lo, unsigned hi) noexcept
+        {
+            if (lo == 0 && hi >= 0xFFF) // a new program
+            {
+                flush();
+                std::fill_n(drops, 4096, 0);
+                return;
+            }
+            // most stores go to data, away from any code
+            unsigned addr = lo;
+            while (addr <= hi && !translated[addr])
+                ++addr;
+            if (addr > hi)
+                return;
+            const std::size_t count = live.size();
+            live.erase(std::remove_if(live.begin(), live.end(), [this, lo, hi](std::uint16_t start) noexcept {
+                Block& block = blocks[start];
+                if (block.start > hi || block.end <= lo)
+                    return false;
+                block.code = nullptr;
+                if (drops[start] < max_drops)
+                    ++drops[start];
+                return true;
+            }), live.end());
+            if (live.size() == count)
+                return;
+            translated.reset();
+            for (std::uint16_t start : live)
+                mark_translated(blocks[start]);
+            links.erase(std::remove_if(links.begin(), links.end(), [this](const Link& link) noexcept {
+                if (blocks[link.target].code)
+                    return false;
+                patch_jump(link.site, link.site + 5);
+                return true;
+            }), links.end());
+        }
+
+        void flush() noexcept
+        {
+            for (std::uint16_t start : live)
+                blocks[start].code = nullptr;
+            live.clear();
+            links.clear();
+            translated.reset();
+            code_size = stubs_size;
+            ++flushes;
+        }
+    };
+
+    JitCache::BlockEnd JitCache::translate_instruction(unsigned opcode, unsigned next, bool& timer_access) noexcept
+    {
+        const unsigned nnn = opcode & 0xFFF;
+        const unsigned n   = opcode & 0xF;
+        const unsigned kk  = opcode & 0xFF;
+
+        const unsigned x = opcode >> 8 & 0xF;
+        const unsigned y = opcode >> 4 & 0xF;
+
+        const std::uint32_t Vx = off.Vs + x, Vy = off.Vs + y, VF = off.Vs + 0xF;
+
+        switch (opcode >> 12)
+        {
+            case 0x0:
+                if (nnn == 0x0E0) // CLS
+                    call(cls, next, 0);
+                else if (nnn == 0x0EE) // RET - with SP at 16 the stack slot read is PC itself
+                {
+                    store_word_imm(off.PC, next);
+                    load_byte(eax, off.SP);
+                    emit({0x0F, 0xB7, 0x8C, 0x43}); emit32(off.stack); // movzx ecx, word [rbx + rax * 2 + stack]
+                    store_word(off.PC, ecx);
+                    emit({0xFE, 0xC8});                                 // dec al
+                    store_byte(off.SP, eax);
+                    exit_indirect();
+                    return BlockEnd::branched;
+                }
+                return BlockEnd::open;
+            case 0x1: // JP addr
+                exit_to(nnn);
+                return BlockEnd::branched;
+            case 0x2: // CALL addr
+                load_byte(eax, off.SP);
+                emit({0xFE, 0xC0});                                     // inc al
+                store_byte(off.SP, eax);
+                emit({0x66, 0xC7, 0x84, 0x43}); emit32(off.stack); emit16(next); // mov word [rbx + rax * 2 + stack], next
+                emit({0x3C, static_cast<unsigned char>(first_code_level)});   // cmp al, first level in the program area
+                emit({0x73, 0});                                        // jae past the exit
+                {
+                    unsigned char* const overflow = out;
+                    exit_to(nnn);
+                    overflow[-1] = out - overflow;
+                }
+                // the push landed in the program area: C++ drops the blocks it overwrote before going on
+                call(stack_written, nnn, 0);
+                emit({0xE9}); emit_rel32(miss_stub);
+                return BlockEnd::branched;
+            case 0x3: // SE Vx, byte
+                load_byte(eax, Vx);
+                emit({0x3C, static_cast<unsigned char>(kk)});           // cmp al, kk
+                skip_unless(0x75, next);                                // jne
+                return BlockEnd::branched;
+            case 0x4: // SNE Vx, byte
+                load_byte(eax, Vx);
+                emit({0x3C, static_cast<unsigned char>(kk)});
+                skip_unless(0x74, next);                                // je
+                return BlockEnd::branched;
+            case 0x5: // SE Vx, Vy
+                if (n)
+                    return BlockEnd::open;
+                load_byte(eax, Vx);
+                load_byte(ecx, Vy);
+                emit({0x38, 0xC8});                                     // cmp al, cl
+                skip_unless(0x75, next);
+                return BlockEnd::branched;
+            case 0x6: // LD Vx, byte
+                store_byte_imm(Vx, kk);
+                return BlockEnd::open;
+            case 0x7: // ADD Vx, byte
+                emit({0x80}); modrm_rbx(eax, Vx); emit({static_cast<unsigned char>(kk)});
+                return BlockEnd::open;
+            case 0x8:
+                switch (n)
+                {
+                    case 0x0: load_byte(eax, Vy); store_byte(Vx, eax);                  break;
+                    case 0x1: load_byte(ecx, Vy); emit({0x08}); modrm_rbx(ecx, Vx);     break; // or  byte, cl
+                    case 0x2: load_byte(ecx, Vy); emit({0x20}); modrm_rbx(ecx, Vx);     break; // and byte, cl
+                    case 0x3: load_byte(ecx, Vy); emit({0x30}); modrm_rbx(ecx, Vx);     break; // xor byte, cl
+                    case 0x4: // ADD Vx, Vy - VF = carry
+                        load_byte(eax, Vx);
+                        load_byte(ecx, Vy);
+                        emit({0x01, 0xC8, 0x89, 0xC2, 0xC1, 0xEA, 0x08});          // add eax, ecx; mov edx, eax; shr edx, 8
+                        store_byte(VF, edx);
+                        store_byte(Vx, eax);
+                        break;
+                    case 0x5: // SUB Vx, Vy - VF = NOT borrow
+                    case 0x7: // SUBN Vx, Vy
+                        load_byte(eax, n == 0x5 ? Vx : Vy);
+                        load_byte(ecx, n == 0x5 ? Vy : Vx);
+                        emit({0x29, 0xC8, 0x89, 0xC2, 0xC1, 0xEA, 0x08});          // sub eax, ecx; mov edx, eax; shr edx, 8
+                        emit({0x85, 0xD2, 0x0F, 0x94, 0xC2});                      // test edx, edx; sete dl
+                        store_byte(VF, edx);
+                        store_byte(Vx, eax);
+                        break;
+                    case 0x6: // SHR Vx - the shift reads Vx again after VF is set, as execute_instruction does
+                    case 0xE: // SHL Vx
+                        load_byte(eax, Vx);
+                        if (n == 0x6) emit({0x83, 0xE0, 0x01});                    // and eax, 1
+                        else          emit({0xC1, 0xE8, 0x07});                    // shr eax, 7
+                        store_byte(VF, eax);
+                        load_byte(eax, Vx);
+                        if (n == 0x6) emit({0xD1, 0xE8});                          // shr eax, 1
+                        else          emit({0xD1, 0xE0});                          // shl eax, 1
+                        store_byte(Vx, eax);
+                        break;
+                }
+                return BlockEnd::open;
+            case 0x9: // SNE Vx, Vy
+                if (n)
+                    return BlockEnd::open;
+                load_byte(eax, Vx);
+                load_byte(ecx, Vy);
+                emit({0x38, 0xC8});
+                skip_unless(0x74, next);
+                return BlockEnd::branched;
+            case 0xA: // LD I, addr
+                store_word_imm(off.I, nnn);
+                return BlockEnd::open;
+            case 0xB: // JP V0, addr
+                load_byte(eax, off.Vs);
+                emit({0x05}); emit32(nnn);                              // add eax, nnn
+                store_word(off.PC, eax);
+                exit_indirect();
+                return BlockEnd::branched;
+            case 0xC: // RND Vx, byte
+                call(rnd, next, x, kk);
+                return BlockEnd::open;
+            case 0xD: // DRW Vx, Vy, nibble
+                call(drw, next, x, y, n);
+                return BlockEnd::open;
+            case 0xE:
+                if (kk != 0x9E && kk != 0xA1)
+                    return BlockEnd::open;
+                load_byte(eax, Vx);
+                emit({0x0F, 0xB6, 0x84, 0x03}); emit32(off.keys);       // movzx eax, byte [rbx + rax + keys]
+                emit({0x84, 0xC0});                                     // test al, al
+                skip_unless(kk == 0x9E ? 0x74 : 0x75, next);            // SKP: jz, SKNP: jnz
+                return BlockEnd::branched;
+            default:
+                switch (kk)
+                {
+                    case 0x07: // LD Vx, DT
+                        timer_access = true;
+                        load_byte(eax, off.delay_timer);
+                        store_byte(Vx, eax);
+                        return BlockEnd::open;
+                    case 0x0A: // LD Vx, K - the machine waits from here on
+                        store_byte_imm(off.wait_key, x);
+                        store_word_imm(off.PC, next);
+                        return BlockEnd::closed;
+                    case 0x15: // LD DT, Vx
+                    case 0x18: // LD ST, Vx
+                        timer_access = true;
+                        load_byte(eax, Vx);
+                        store_byte(kk == 0x15 ? off.delay_timer : off.sound_timer, eax);
+                        return BlockEnd::open;
+                    case 0x1E: // ADD I, Vx - VF = I + Vx > 0xFFF
+                        load_word(eax, off.I);
+                        load_byte(ecx, Vx);
+                        emit({0x01, 0xC8});                             // add eax, ecx
+                        store_word(off.I, eax);
+                        emit({0xC1, 0xE8, 0x0C});                       // shr eax, 12
+                        store_byte(VF, eax);
+                        return BlockEnd::open;
+                    case 0x29: // LD F, Vx
+                        load_byte(eax, Vx);
+                        emit({0x6B, 0xC0, 0x05});                       // imul eax, eax, 5
+                        store_word(off.I, eax);
+                        return BlockEnd::open;
+                    case 0x33: // LD B, Vx
+                        call(bcd, next, x);
+                        return BlockEnd::closed;
+                    case 0x55: // LD [I], Vx
+                        call(store, next, x);
+                        return BlockEnd::closed;
+                    case 0x65: // LD Vx, [I]
+                        call(load, next, x);
+                        return BlockEnd::open;
+                }
+                return BlockEnd::open;
+        }
+    }
+
+    const JitCache::Block* JitCache::translate(const Interpreter& interp, unsigned start) noexcept
+    {
+        if (code_size + max_block_bytes > code_capacity)
+            flush();
+
+        // the checks take the length, known at the end, patched in then
+        unsigned char* const entry = out = code + code_size;
+        emit({0x49, 0x83, 0xFD, 0x00});                    // cmp r13, length
+        emit({0x0F, 0x82}); emit_rel32(miss_stub);         // jb miss
+        emit({0x4D, 0x85, 0xF6, 0x7F, 0x05});              // test r14, r14; jg +5
+        emit({0xE8}); emit_rel32(tick_stub);               // call tick
+        emit({0x49, 0x83, 0xED, 0x00});                    // sub r13, length
+        emit({0x49, 0x83, 0xEE, 0x00});                    // sub r14, length
+
+        // an instruction reading or writing DT/ST starts a block, right after the ticks due fired,
+        // so the ticks a block straddles only ever fire late for instructions that cannot see them
+        unsigned pc = start, length = 0;
+        BlockEnd end = BlockEnd::open;
+        while (end == BlockEnd::open && length < max_block_length && pc <= 0xFFE)
+        {
+            const unsigned opcode = interp.mem[pc] << 8 | interp.mem[pc + 1];
+            unsigned char* const instruction = out;
+            bool timer_access = false;
+            end = translate_instruction(opcode, pc + 2, timer_access);
+            if (timer_access && length > 0)
+            {
+                out = instruction;
+                end = BlockEnd::open;
+                break;
+            }
+            pc += 2;
+            ++length;
+        }
+        if (end == BlockEnd::open)
+            exit_to(pc);
+        else if (end == BlockEnd::closed) // a key wait or a store C++ has to see, PC is stored already
+        {
+            emit({0xE9}); emit_rel32(miss_stub);
+        }
+        code_size = out - code;
+
+        for (unsigned char* length_imm : {entry + 3, entry + 23, entry + 27})
+            *length_imm = length;
+
+        Block& block = blocks[start];
+        block = {entry,
+                 static_cast<std::uint16_t>(start),
+                 static_cast<std::uint16_t>(pc),
+                 static_cast<std::uint16_t>(length)};
+        live.push_back(start);
+        mark_translated(block);
+        return &block;
+    }
+
+    void JitCache::emit_stubs() noexcept
+    {
+        out = code;
+
+        // enter(mem, interp, entry, state): saves the callee-saved registers and `state`, loads them, jumps in
+        enter_stub = out;
+        emit({0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, 0x51}); // push rbx, rbp, r12-r15, rcx
+        emit({0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4});        // mov rbx, rdi; mov r12, rsi
+        emit({0x4C, 0x8B, 0x29});                          // mov r13, [rcx]
+        emit({0x4C, 0x8B, 0x71, 0x08});                    // mov r14, [rcx + 8]
+        emit({0x48, 0x8B, 0x69, 0x10});                    // mov rbp, [rcx + 16]
+        emit({0x49, 0xBF}); emit64(reinterpret_cast<std::uintptr_t>(blocks)); // mov r15, blocks
+        emit({0xFF, 0xE2});                                // jmp rdx
+
+        miss_stub = out;
+        emit({0x31, 0xC0});                                // xor eax, eax
+
+        exit_stub = out;
+        emit({0x59, 0x4C, 0x89, 0x29, 0x4C, 0x89, 0x71, 0x08}); // pop rcx; mov [rcx], r13; mov [rcx + 8], r14
+        emit({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3}); // pop r15-r12, rbp, rbx; ret
+
+        // fires every tick due, several if the last block straddled them
+        tick_stub = out;
+        load_byte(eax, off.delay_timer);
+        emit({0x85, 0xC0, 0x74, 0x08, 0xFF, 0xC8});        // test eax, eax; jz +8; dec eax
+        store_byte(off.delay_timer, eax);
+        load_byte(eax, off.sound_timer);
+        emit({0x85, 0xC0, 0x74, 0x08, 0xFF, 0xC8});
+        store_byte(off.sound_timer, eax);
+        emit({0x49, 0x01, 0xEE});                          // add r14, rbp
+        emit({0x4D, 0x85, 0xF6});                          // test r14, r14
+        emit({0x0F, 0x8E}); emit_rel32(tick_stub);         // jle tick
+        emit({0xC3});                                      // ret
+
+        code_size = stubs_size = out - code;
+    }
+
+    void destroy_jit_cache(JitCache* cache) noexcept {delete cache;}
+
+    template<>
+    void Interpreter::run<Dispatch::jit>(std::uint64_t cycles) noexcept
+    {
+        if (!jit_cache)
+            jit_cache.reset(new (std::nothrow) JitCache{*this});
+        if (!jit_cache || !jit_cache->usable())
+        {
+            run<Dispatch::threaded>(cycles);
+            return;
+        }
+
+        clock += cycles;
+        while (cycles)
+        {
+            if (interp_data.wait_key)
+            {
+                elapse(cycles);
+                break;
+            }
+            if (tick_phase >= cycles_per_tick)
+            {
+                update_timers();
+                tick_phase = 0;
+            }
+            if (written_lo <= written_hi)
+            {
+                jit_cache->invalidate(written_lo, written_hi);
+                written_lo = 0xFFFF;
+                written_hi = 0;
+            }
+
+            // blocks run chained until one misses, waits, stores or does not fit
+            if (const auto block = jit_cache->lookup(*this, interp_data.PC))
+            {
+                JitCache::State state{cycles, std::int64_t(cycles_per_tick) - tick_phase, cycles_per_tick};
+                unsigned char* const exit = jit_cache->run(*this, *block, state);
+
+                // the ticks the last block straddled fire as elapse fires them
+                tick_phase = cycles_per_tick - state.tick_left;
+                if (state.tick_left < 0)
+                    elapse(0);
+                const bool ran = state.cycles != cycles;
+                cycles = state.cycles;
+                if (exit)
+                    jit_cache->link(*this, exit);
+                if (ran)
+                    continue;
+            }
+
+            // no block here, or it does not fit the slots left
+            ++tick_phase;
+            --cycles;
+            execute_instruction();
+        }
+    }
+}
+
+#else
+
+namespace chip8
+{
+    class JitCache {};
+
+    void destroy_jit_cache(JitCache* cache) noexcept {delete cache;}
+
+    template<>
+    void Interpreter::run<Dispatch::jit>(std::uint64_t cycles) noexcept {run<Dispatch::threaded>(cycles);}
+}
+
+#endif
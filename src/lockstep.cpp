@@ -0,0 +1,302 @@
+#include "lockstep.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace chip8
+{
+    namespace
+    {
+        constexpr std::size_t vector_width = 32;
+
+#if defined(__GNUC__)
+        typedef unsigned char Bytes __attribute__((vector_size(vector_width)));
+
+#   if defined(__x86_64__) && defined(__linux__)
+#       define CHIP8_LANE_KERNEL __attribute__((target_clones("avx2", "default")))
+#   else
+#       define CHIP8_LANE_KERNEL
+#   endif
+
+        // 32-byte vectors are passed by reference, by value they would depend on the AVX ABI
+        inline void load (Bytes& v, const unsigned char* p) noexcept {std::memcpy(&v, p, sizeof v);}
+        inline void store(unsigned char* p, const Bytes& v) noexcept {std::memcpy(p, &v, sizeof v);}
+
+        CHIP8_LANE_KERNEL void add_bytes(unsigned char* v, unsigned char value, std::size_t count) noexcept
+        {
+            for (std::size_t i = 0; i < count; i += vector_width)
+            {
+                Bytes a;
+                load(a, v + i);
+                store(v + i, a + value);
+            }
+        }
+
+        // 8XYN for every lane, VF is written before Vx as in execute_instruction
+        CHIP8_LANE_KERNEL void alu(unsigned n, unsigned char* vx, const unsigned char* vy, unsigned char* vf,
+                std::size_t count) noexcept
+        {
+            for (std::size_t i = 0; i < count; i += vector_width)
+            {
+                Bytes a, b;
+                load(a, vx + i);
+                load(b, vy + i);
+                switch (n)
+                {
+                    case 0x0: store(vx + i, b);     break;
+                    case 0x1: store(vx + i, a | b); break;
+                    case 0x2: store(vx + i, a & b); break;
+                    case 0x3: store(vx + i, a ^ b); break;
+                    case 0x4:
+                    {
+                        const Bytes sum = a + b;
+                        store(vf + i, (Bytes)(sum < a) & 1);
+                        store(vx + i, sum);
+                        break;
+                    }
+                    case 0x5: store(vf + i, (Bytes)(a >= b) & 1); store(vx + i, a - b); break;
+                    case 0x7: store(vf + i, (Bytes)(b >= a) & 1); store(vx + i, b - a); break;
+                    case 0x6: store(vf + i, a & 1 ); load(a, vx + i); store(vx + i, a >> 1); break;
+                    case 0xE: store(vf + i, a >> 7); load(a, vx + i); store(vx + i, a << 1); break;
+                }
+            }
+        }
+
+#   undef CHIP8_LANE_KERNEL
+#else
+        // 8XYN for one lane, VF is written before Vx as in execute_instruction
+        void alu_lane(unsigned n, unsigned char& vx, unsigned char vy, unsigned char& vf) noexcept
+        {
+            const unsigned a = vx, b = vy;
+            switch (n)
+            {
+                case 0x0: vx  = b; break;
+                case 0x1: vx |= b; break;
+                case 0x2: vx &= b; break;
+                case 0x3: vx ^= b; break;
+                case 0x4: vf = (a + b) >> 8; vx = a + b; break;
+                case 0x5: vf = a >= b;       vx = a - b; break;
+                case 0x7: vf = b >= a;       vx = b - a; break;
+                case 0x6: vf = a & 1;        vx >>= 1;   break;
+                case 0xE: vf = a >> 7;       vx <<= 1;   break;
+            }
+        }
+
+        void add_bytes(unsigned char* v, unsigned char value, std::size_t count) noexcept
+        {
+            for (std::size_t i = 0; i < count; ++i)
+                v[i] += value;
+        }
+
+        void alu(unsigned n, unsigned char* vx, const unsigned char* vy, unsigned char* vf, std::size_t count) noexcept
+        {
+            for (std::size_t i = 0; i < count; ++i)
+                alu_lane(n, vx[i], vy[i], vf[i]);
+        }
+#endif
+    }
+
+    Lockstep::Lockstep(const Interpreter& prototype, std::size_t lanes) :
+        count          {lanes},
+        stride         {(lanes + vector_width - 1) / vector_width * vector_width},
+        machines       (lanes, prototype),
+        Vs             (16 * stride),
+        PC             (stride),
+        I              (stride),
+        waiting        {prototype.wait() ? lanes : 0},
+        cycles_per_tick{prototype.cycles_per_tick},
+        tick_phase     {prototype.tick_phase},
+        clock          {prototype.clock}
+    {
+        // only the lanes' own stores count as code written from here on
+        for (Interpreter& machine : machines)
+        {
+            machine.written_lo = 0xFFFF;
+            machine.written_hi = 0;
+        }
+    }
+
+    void Lockstep::load_rows(std::uint32_t rows) noexcept
+    {
+        rows &= ~loaded;
+        for (unsigned r = 0; r < 16; ++r)
+            if (rows & 1u << r)
+                for (std::size_t lane = 0; lane < count; ++lane)
+                    Vs[r * stride + lane] = machines[lane].interp_data.Vs[r];
+        if (rows & row_I)
+            for (std::size_t lane = 0; lane < count; ++lane)
+                I[lane] = machines[lane].interp_data.I;
+        if (rows & row_PC)
+            for (std::size_t lane = 0; lane < count; ++lane)
+                PC[lane] = machines[lane].interp_data.PC;
+        loaded |= rows;
+    }
+
+    void Lockstep::write_back() noexcept
+    {
+        for (unsigned r = 0; r < 16; ++r)
+            if (dirty & 1u << r)
+                for (std::size_t lane = 0; lane < count; ++lane)
+                    machines[lane].interp_data.Vs[r] = Vs[r * stride + lane];
+        if (dirty & row_I)
+            for (std::size_t lane = 0; lane < count; ++lane)
+                machines[lane].interp_data.I = I[lane];
+        if (dirty & row_PC)
+            for (std::size_t lane = 0; lane < count; ++lane)
+                machines[lane].interp_data.PC = PC[lane];
+        loaded = dirty = 0;
+    }
+
+    void Lockstep::set_wait_key(std::size_t lane, int code) noexcept
+    {
+        write_back();
+        if (machines[lane].wait())
+            --waiting;
+        machines[lane].set_wait_key(code);
+        waiting += machines[lane].wait();
+    }
+
+    void Lockstep::key_event(std::size_t lane, int code, bool down) noexcept
+    {
+        write_back();
+        if (machines[lane].wait())
+            --waiting;
+        machines[lane].key_event(code, down);
+        waiting += machines[lane].wait();
+    }
+
+    bool Lockstep::same_pc() const noexcept
+    {
+        const unsigned first = pc(0);
+        for (std::size_t lane = 1; lane < count; ++lane)
+            if (pc(lane) != first)
+                return false;
+        return true;
+    }
+
+    bool Lockstep::same_opcode() const noexcept
+    {
+        const unsigned       pc    = this->pc(0);
+        const unsigned char* first = machines[0].mem;
+        for (std::size_t lane = 1; lane < count; ++lane)
+        {
+            const unsigned char* const mem = machines[lane].mem;
+            if (mem[pc] != first[pc] || mem[pc + 1] != first[pc + 1])
+                return false;
+        }
+        return true;
+    }
+
+    void Lockstep::step_uniform(unsigned opcode) noexcept
+    {
+        const unsigned nnn = opcode & 0xFFF;
+        const unsigned n   = opcode & 0xF;
+        const unsigned kk  = opcode & 0xFF;
+        const unsigned x   = opcode >> 8 & 0xF;
+        const unsigned y   = opcode >> 4 & 0xF;
+
+        unsigned char* const Vx = &Vs[x   * stride];
+        unsigned char* const Vy = &Vs[y   * stride];
+        unsigned char* const VF = &Vs[0xF * stride];
+
+        load_rows(row_PC);
+        switch (opcode >> 12)
+        {
+            case 0x6: // a row written whole needs no loading
+                std::fill_n(Vx, stride, kk);
+                loaded |= 1u << x;
+                dirty  |= 1u << x;
+                break;
+            case 0x7:
+                load_rows(1u << x);
+                add_bytes(Vx, kk, stride);
+                dirty |= 1u << x;
+                break;
+            case 0x8:
+                load_rows(1u << x | 1u << y | 1u << 0xF);
+                alu(n, Vx, Vy, VF, stride);
+                dirty |= 1u << x | 1u << 0xF;
+                break;
+            case 0xA:
+                std::fill(I.begin(), I.end(), nnn);
+                loaded |= row_I;
+                dirty  |= row_I;
+                break;
+            case 0xC:
+                for (std::size_t lane = 0; lane < count; ++lane)
+                    Vx[lane] = machines[lane].random_byte() & kk;
+                loaded |= 1u << x;
+                dirty  |= 1u << x;
+                break;
+        }
+        std::fill(PC.begin(), PC.end(), PC[0] + 2);
+        dirty |= row_PC;
+    }
+
+    void Lockstep::step_lanes() noexcept
+    {
+        waiting = 0;
+        for (Interpreter& machine : machines)
+        {
+            if (!machine.wait())
+                machine.execute_instruction();
+            waiting += machine.wait();
+
+            // a stack deeper than 16 levels runs on past PC and I towards the program area
+            if ((machine.written_lo <= machine.written_hi && machine.written_hi >= 0x200) ||
+                    machine.interp_data.SP >= 16)
+                code_written = true;
+        }
+        converged = same_pc();
+    }
+
+    void Lockstep::run(std::uint64_t cycles) noexcept
+    {
+        clock += cycles;
+        for (; cycles; --cycles)
+        {
+            if (tick_phase >= cycles_per_tick)
+            {
+                for (Interpreter& machine : machines)
+                    machine.update_timers();
+                tick_phase = 0;
+            }
+            ++tick_phase;
+
+            if (waiting == count)
+                continue;
+
+            // below 0x200 sit each lane's own registers, stack and display, and an address past the
+            // end wraps around; lane 0's opcode stands for the others only in the program area
+            const unsigned pc = this->pc(0);
+            if (!waiting && converged && pc >= 0x200 && pc <= 0xFFE && (!code_written || same_opcode()))
+            {
+                const unsigned opcode = machines[0].mem[pc] << 8 | machines[0].mem[pc + 1];
+                switch (opcode >> 12)
+                {
+                    case 0x6: case 0x7: case 0x8: case 0xA: case 0xC:
+                        step_uniform(opcode);
+                        ++uniform_slots;
+                        continue;
+                }
+            }
+            write_back();
+            step_lanes();
+        }
+    }
+
+    Interpreter Lockstep::machine(std::size_t lane) const noexcept
+    {
+        Interpreter machine{machines[lane]};
+        for (unsigned r = 0; r < 16; ++r)
+            if (dirty & 1u << r)
+                machine.interp_data.Vs[r] = Vs[r * stride + lane];
+        if (dirty & row_I)
+            machine.interp_data.I  = I [lane];
+        if (dirty & row_PC)
+            machine.interp_data.PC = PC[lane];
+        machine.tick_phase = tick_phase;
+        machine.clock      = clock;
+        return machine;
+    }
+}
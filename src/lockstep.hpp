@@ -0,0 +1,85 @@
+#ifndef CHIP8_LOCKSTEP_HPP
+#define CHIP8_LOCKSTEP_HPP
+
+#include "chip8.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace chip8
+{
+    /*
+     * Runs many copies of one machine in lockstep, e.g. the same ROM under different key inputs.
+     * Every lane is an Interpreter; Vs, I and PC are also kept as structure-of-arrays, one row per
+     * register and one column per lane. While every lane sits on the same opcode, 6XNN, 7XNN, ANNN
+     * and the 8XYN group execute once for all lanes on SIMD vectors and CXNN draws from every
+     * lane's own generator in one pass. Any other op, and every op once the lanes' PCs diverge,
+     * runs through each lane's execute_instruction, so a lane behaves as the scalar interpreter
+     * does down to an overflowed stack or I pointing into the registers.
+     *
+     * The rows cache the lanes' registers: a vector op loads the rows it reads, the rows it
+     * changed are written back before the next op that runs lane by lane, and that op leaves
+     * every row stale. DT and ST have no rows: FX07, FX15 and FX18 always run lane by lane, and
+     * the 60 Hz tick counts them down in each lane's Interpreter.
+     */
+    class Lockstep
+    {
+        std::size_t count, stride; // lanes and lanes padded to the vector width
+
+        std::vector<Interpreter>    machines;   // a lane each
+        std::vector<unsigned char>  Vs;         // [register][lane]
+        std::vector<unsigned short> PC, I;
+
+        // rows by bit: Vs 0-15, I, PC; loaded ones match the lanes or are newer, dirty ones are newer
+        static constexpr std::uint32_t row_I = 1u << 16, row_PC = 1u << 17;
+        std::uint32_t loaded = 0, dirty = 0;
+
+        std::size_t   waiting = 0;
+        unsigned      cycles_per_tick, tick_phase;
+        std::uint64_t clock, uniform_slots = 0;
+
+        bool converged    = true;   // every lane has the same PC
+        bool code_written = false;  // a lane stored into the program area, opcodes may differ
+
+        unsigned pc(std::size_t lane) const noexcept {return loaded & row_PC ? PC[lane] : machines[lane].interp_data.PC;}
+
+        void load_rows(std::uint32_t rows) noexcept;
+        void write_back() noexcept; // stores the dirty rows into the lanes and drops every row
+
+        bool same_pc()     const noexcept;
+        bool same_opcode() const noexcept;
+
+        void step_uniform(unsigned opcode) noexcept;
+        void step_lanes() noexcept;
+
+    public:
+        Lockstep(const Interpreter& prototype, std::size_t lanes);
+
+        std::size_t lanes() const noexcept {return count;}
+
+        void update_key(std::size_t lane, int code, bool status) noexcept {machines[lane].update_key(code, status);}
+
+        void set_wait_key(std::size_t lane, int code) noexcept;
+
+        // a key change as Interpreter::key_event makes it, a press also ends the lane's FX0A wait
+        void key_event(std::size_t lane, int code, bool down) noexcept;
+
+        bool wait(std::size_t lane) const noexcept {return machines[lane].wait();}
+
+        void seed(std::size_t lane, std::uint64_t value) noexcept {machines[lane].seed(value);}
+
+        // advances every lane by `cycles` slots with the timers of Interpreter::run
+        void run(std::uint64_t cycles) noexcept;
+
+        // the state of one lane as a standalone interpreter
+        Interpreter machine(std::size_t lane) const noexcept;
+
+        std::uint64_t cycles() const noexcept {return clock;}
+
+        // slots executed once for all lanes
+        std::uint64_t lockstep_cycles() const noexcept {return uniform_slots;}
+    };
+}
+
+#endif
@@ -0,0 +1,180 @@
+#include "profile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <utility>
+
+namespace chip8
+{
+    namespace
+    {
+        const char* const names[Profiler::opcode_classes] =
+        {
+            "00E0 CLS",   "00EE RET",   "0NNN SYS",   "1NNN JP",    "2NNN CALL",  "3XNN SE",    "4XNN SNE",
+            "5XY0 SE",    "6XNN LD",    "7XNN ADD",   "8XY0 LD",    "8XY1 OR",    "8XY2 AND",   "8XY3 XOR",
+            "8XY4 ADD",   "8XY5 SUB",   "8XY6 SHR",   "8XY7 SUBN",  "8XYE SHL",   "9XY0 SNE",   "ANNN LD I",
+            "BNNN JP V0", "CXNN RND",   "DXYN DRW",   "EX9E SKP",   "EXA1 SKNP",  "FX07 LD DT", "FX0A LD K",
+            "FX15 LD DT", "FX18 LD ST", "FX1E ADD I", "FX29 LD F",  "FX33 LD B",  "FX55 LD [I]","FX65 LD [I]",
+            "invalid"
+        };
+
+        constexpr unsigned invalid = Profiler::opcode_classes - 1;
+
+        std::string hex(unsigned value)
+        {
+            char buffer[8];
+            std::snprintf(buffer, sizeof buffer, "0x%03X", value);
+            return buffer;
+        }
+    }
+
+    unsigned Profiler::classify(unsigned opcode) noexcept
+    {
+        const unsigned n = opcode & 0xF, kk = opcode & 0xFF;
+        switch (opcode >> 12)
+        {
+            case 0x0: return opcode == 0x00E0 ? 0 : opcode == 0x00EE ? 1 : 2;
+            case 0x5: return n ? invalid : 7;
+            case 0x8:
+                if (n <= 7) return 10 + n;
+                return n == 0xE ? 18 : invalid;
+            case 0x9: return n ? invalid : 19;
+            case 0xE: return kk == 0x9E ? 24 : kk == 0xA1 ? 25 : invalid;
+            case 0xF:
+                switch (kk)
+                {
+                    case 0x07: return 26;
+                    case 0x0A: return 27;
+                    case 0x15: return 28;
+                    case 0x18: return 29;
+                    case 0x1E: return 30;
+                    case 0x29: return 31;
+                    case 0x33: return 32;
+                    case 0x55: return 33;
+                    case 0x65: return 34;
+                }
+                return invalid;
+            case 0xA: return 20;
+            case 0xB: return 21;
+            case 0xC: return 22;
+            case 0xD: return 23;
+            default:  return (opcode >> 12) + 2; // 1NNN-4XNN, 6XNN and 7XNN
+        }
+    }
+
+    const char* Profiler::class_name(unsigned index) noexcept
+    {
+        return names[std::min(index, invalid)];
+    }
+
+    Profiler::Profiler(std::string root) :
+        root{std::move(root)}, by_address(4096), stack_slots{&stacks[calls]}
+    {
+    }
+
+    void Profiler::execute(unsigned pc, unsigned opcode)
+    {
+        const unsigned index = classify(opcode);
+        ++executed;
+        ++by_class[index];
+        ++by_address[pc];
+        ++*stack_slots;
+        waiting = false;
+
+        if (index == 23)
+        {
+            if (draws++)
+            {
+                const std::uint64_t gap = slots() - last_draw;
+                draw_gap_sum += gap;
+                draw_gap_min  = std::min(draw_gap_min, gap);
+                draw_gap_max  = std::max(draw_gap_max, gap);
+            }
+            last_draw = slots();
+        }
+        else if (index == 4 || (index == 1 && !calls.empty()))
+        {
+            if (index == 4)
+            {
+                // like the machine's stack the 16 innermost calls are kept
+                if (calls.size() == 16)
+                    calls.erase(calls.begin());
+                calls.push_back(opcode & 0xFFF);
+            }
+            else
+                calls.pop_back();
+            stack_slots = &stacks[calls];
+        }
+    }
+
+    void Profiler::wait(std::uint64_t slots)
+    {
+        waited += slots;
+        waits  += !waiting;
+        waiting = true;
+
+        calls.push_back(0xFFFF);    // idle slots show up as a "wait" frame on top of the caller
+        stacks[calls] += slots;
+        calls.pop_back();
+    }
+
+    void Profiler::report(std::ostream& out, std::size_t addresses) const
+    {
+        char line[128];
+        const auto percent = [this](std::uint64_t count) {return slots() ? 100.0 * count / slots() : 0.0;};
+
+        out << root << '\n';
+        std::snprintf(line, sizeof line, "  slots %llu, executed %llu, idle in FX0A %llu (%.1f%%) over %llu waits\n",
+                static_cast<unsigned long long>(slots()), static_cast<unsigned long long>(executed),
+                static_cast<unsigned long long>(waited), percent(waited), static_cast<unsigned long long>(waits));
+        out << line;
+
+        std::vector<unsigned> order(opcode_classes);
+        for (unsigned i = 0; i < opcode_classes; ++i)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [this](unsigned a, unsigned b) {return by_class[a] > by_class[b];});
+        out << "  opcode classes\n";
+        for (unsigned i : order)
+            if (by_class[i])
+            {
+                std::snprintf(line, sizeof line, "    %-12s %14llu %6.2f%%\n", names[i],
+                        static_cast<unsigned long long>(by_class[i]), percent(by_class[i]));
+                out << line;
+            }
+
+        std::vector<unsigned> hot;
+        for (unsigned pc = 0; pc < by_address.size(); ++pc)
+            if (by_address[pc])
+                hot.push_back(pc);
+        std::stable_sort(hot.begin(), hot.end(), [this](unsigned a, unsigned b) {return by_address[a] > by_address[b];});
+        hot.resize(std::min(hot.size(), addresses));
+        out << "  hottest addresses\n";
+        for (unsigned pc : hot)
+        {
+            std::snprintf(line, sizeof line, "    0x%03X %14llu %6.2f%%\n", pc,
+                    static_cast<unsigned long long>(by_address[pc]), percent(by_address[pc]));
+            out << line;
+        }
+
+        if (draws > 1)
+        {
+            std::snprintf(line, sizeof line, "  DXYN %llu times, slots between draws: mean %.1f, min %llu, max %llu\n",
+                    static_cast<unsigned long long>(draws), double(draw_gap_sum) / (draws - 1),
+                    static_cast<unsigned long long>(draw_gap_min), static_cast<unsigned long long>(draw_gap_max));
+            out << line;
+        }
+    }
+
+    void Profiler::folded(std::ostream& out) const
+    {
+        for (const auto& stack : stacks)
+        {
+            if (!stack.second)
+                continue;
+            out << root;
+            for (unsigned short address : stack.first)
+                out << ';' << (address == 0xFFFF ? std::string{"wait"} : hex(address));
+            out << ' ' << stack.second << '\n';
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef CHIP8_PROFILE_HPP
+#define CHIP8_PROFILE_HPP
+
+#include "chip8.hpp"
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace chip8
+{
+    /*
+     * An observer for Interpreter::run_observed counting every executed instruction by opcode
+     * class, by address and by call stack, the slots between DXYNs and the slots idled in FX0A.
+     * Call stacks follow 2NNN and 00EE and are named by the called addresses under `root`.
+     */
+    class Profiler
+    {
+    public:
+        static constexpr unsigned opcode_classes = 36;
+
+        // the class of an opcode as an index into class_name, e.g. 23 and "DXYN DRW"
+        static unsigned    classify(unsigned opcode) noexcept;
+        static const char* class_name(unsigned index) noexcept;
+
+        explicit Profiler(std::string root = "rom");
+
+        // stack_slots points into the profiler's own `stacks`
+        Profiler           (const Profiler&) = delete;
+        Profiler& operator=(const Profiler&) = delete;
+
+        void execute(unsigned pc, unsigned opcode);
+        void wait(std::uint64_t slots);
+
+        // totals, the opcode classes, the hottest `addresses` addresses, DXYN spacing and key waits
+        void report(std::ostream& out, std::size_t addresses = 32) const;
+
+        // one `root;0x2A4;0x31C slots` line per call stack, the format of flamegraph.pl
+        void folded(std::ostream& out) const;
+
+        std::uint64_t slots()      const noexcept {return executed + waited;}
+        std::uint64_t wait_slots() const noexcept {return waited;}
+
+    private:
+        std::string root;
+
+        std::uint64_t executed = 0, waited = 0, waits = 0;
+        std::uint64_t by_class[opcode_classes]{};
+        std::vector<std::uint64_t> by_address;
+
+        std::uint64_t draws = 0, last_draw = 0, draw_gap_sum = 0, draw_gap_min = UINT64_MAX, draw_gap_max = 0;
+
+        std::vector<unsigned short> calls;  // the return-free call stack, innermost last
+        std::map<std::vector<unsigned short>, std::uint64_t> stacks;
+        std::uint64_t* stack_slots;         // the counter of `calls`, looked up only when it changes
+        bool waiting = false;
+    };
+}
+
+#endif
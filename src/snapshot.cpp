@@ -0,0 +1,42 @@
+#include "snapshot.hpp"
+
+#include <algorithm>
+
+namespace chip8
+{
+    SnapshotRing::SnapshotRing(std::size_t capacity, std::size_t interval) :
+        slots(std::max<std::size_t>(capacity, 1) * Interpreter::state_size),
+        capacity{std::max<std::size_t>(capacity, 1)}, interval{std::max<std::size_t>(interval, 1)}
+    {
+    }
+
+    void SnapshotRing::frame_end(const Interpreter& machine) noexcept
+    {
+        if (++frame == interval)
+        {
+            frame = 0;
+            record(machine);
+        }
+    }
+
+    void SnapshotRing::record(const Interpreter& machine) noexcept
+    {
+        machine.save_state(slots.data() + next * Interpreter::state_size);
+        next   = (next + 1) % capacity;
+        stored = std::min(stored + 1, capacity);
+    }
+
+    bool SnapshotRing::rewind(Interpreter& machine, std::size_t age) noexcept
+    {
+        if (age >= stored)
+            return false;
+
+        const std::size_t slot = (next + capacity - 1 - age) % capacity;
+        if (!machine.load_state(slots.data() + slot * Interpreter::state_size, Interpreter::state_size))
+            return false;
+        next    = (slot + 1) % capacity;
+        stored -= age;
+        frame   = 0;
+        return true;
+    }
+}
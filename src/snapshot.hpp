@@ -0,0 +1,39 @@
+#ifndef CHIP8_SNAPSHOT_HPP
+#define CHIP8_SNAPSHOT_HPP
+
+#include "chip8.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace chip8
+{
+    /*
+     * A fixed ring of saved states for rewind and search: every `interval` frames the caller
+     * reports, the machine is saved over the oldest slot. All slots are allocated up front, so
+     * recording is one copy of the memory image.
+     */
+    class SnapshotRing
+    {
+        std::vector<unsigned char> slots;
+        std::size_t capacity, interval;
+        std::size_t next = 0, stored = 0, frame = 0;
+
+    public:
+        SnapshotRing(std::size_t capacity, std::size_t interval);
+
+        // call once per frame, saves the machine on every `interval`-th call
+        void frame_end(const Interpreter& machine) noexcept;
+
+        void record(const Interpreter& machine) noexcept;
+
+        // restores the state `age` snapshots back, 0 being the latest, and drops the newer ones
+        bool rewind(Interpreter& machine, std::size_t age = 0) noexcept;
+
+        std::size_t size() const noexcept {return stored;}
+
+        void clear() noexcept {next = stored = frame = 0;}
+    };
+}
+
+#endif
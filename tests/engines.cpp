@@ -0,0 +1,98 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "../src/chip8.hpp"
+
+namespace
+{
+    constexpr std::uint64_t run_cycles         = 300000;
+    constexpr unsigned      cycles_per_ticks[] = {1, 3, 10, 17};
+
+    const char* const engine_names[] {"switch", "predecoded", "threaded", "jit"};
+
+    // 7001 2200: a call to itself whose stack runs through PC and I into the program it executes
+    const std::vector<unsigned char> runaway_call {0x70, 0x01, 0x22, 0x00};
+
+    std::vector<unsigned char> load_rom(const char* path)
+    {
+        std::ifstream stream{path, std::ios::in | std::ios::binary};
+        return {std::istreambuf_iterator<char>{stream}, std::istreambuf_iterator<char>{}};
+    }
+
+    void run(chip8::Interpreter& machine, unsigned engine, std::uint64_t cycles)
+    {
+        switch (engine)
+        {
+            case 0:  machine.run<chip8::Dispatch::switch_table>(cycles); break;
+            case 1:  machine.run<chip8::Dispatch::predecoded  >(cycles); break;
+            case 2:  machine.run<chip8::Dispatch::threaded    >(cycles); break;
+            default: machine.run<chip8::Dispatch::jit         >(cycles); break;
+        }
+    }
+
+    // runs the ROM on every engine under the same random keys, returns false at the first state that differs
+    bool compare(const char* path, const std::vector<unsigned char>& rom, unsigned cycles_per_tick)
+    {
+        chip8::Interpreter machines[4];
+        for (chip8::Interpreter& machine : machines)
+        {
+            machine.copy_font(chip8::fonts::original_chip8);
+            machine.copy_rom(rom.data(), rom.size());
+            machine.seed(cycles_per_tick);
+            machine.set_cycles_per_tick(cycles_per_tick);
+        }
+
+        std::vector<unsigned char> expected(chip8::Interpreter::state_size), state(chip8::Interpreter::state_size);
+        std::uint64_t keys = chip8::pcg32_seed(cycles_per_tick);
+        for (std::uint64_t cycle = 0; cycle < run_cycles; )
+        {
+            const std::uint64_t slice = 1 + chip8::pcg32(keys) % 64;
+            const std::uint32_t event = chip8::pcg32(keys);
+            for (unsigned engine = 0; engine < 4; ++engine)
+            {
+                run(machines[engine], engine, slice);
+                if (event % 4 == 0)
+                    machines[engine].key_event(event >> 8 & 0xF, event >> 16 & 1);
+            }
+            cycle += slice;
+
+            machines[0].save_state(expected.data());
+            for (unsigned engine = 1; engine < 4; ++engine)
+            {
+                machines[engine].save_state(state.data());
+                if (state == expected)
+                    continue;
+                const chip8::Registers a = machines[0].registers(), b = machines[engine].registers();
+                std::printf("%s, %u cycles per tick: %s differs from switch by cycle %llu"
+                            " (PC %03X/%03X, SP %02X/%02X)\n", path, cycles_per_tick, engine_names[engine],
+                            static_cast<unsigned long long>(cycle), b.PC, a.PC, b.SP, a.SP);
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+// every engine ends each slice of a run in the state the switch engine does
+int main(int argc, char** argv)
+{
+    int failures = 0;
+    for (unsigned cycles_per_tick : cycles_per_ticks)
+        failures += !compare("runaway call", runaway_call, cycles_per_tick);
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::vector<unsigned char> rom{load_rom(argv[i])};
+        if (rom.empty() || rom.size() > 4096 - 0x200)
+        {
+            std::printf("%s: not a ROM\n", argv[i]);
+            ++failures;
+            continue;
+        }
+        for (unsigned cycles_per_tick : cycles_per_ticks)
+            failures += !compare(argv[i], rom, cycles_per_tick);
+    }
+    return failures != 0;
+}
@@ -0,0 +1,79 @@
+#include <cstdio>
+#include <new>
+#include <vector>
+
+#include "../src/chip8.hpp"
+
+namespace
+{
+    // the byte at `addr` as a saved state holds it
+    unsigned peek(const chip8::Interpreter& machine, unsigned addr)
+    {
+        std::vector<unsigned char> state(chip8::Interpreter::state_size);
+        machine.save_state(state.data());
+        return state[sizeof(chip8::StateHeader) + addr];
+    }
+
+    chip8::Interpreter loaded(unsigned char byte)
+    {
+        chip8::Interpreter machine;
+        machine.copy_rom(&byte, 1);
+        return machine;
+    }
+
+    int failures = 0;
+
+    void expect(const char* what, unsigned got, unsigned wanted)
+    {
+        if (got == wanted)
+            return;
+        std::printf("%s: read %02X, the origin holds %02X\n", what, got, wanted);
+        ++failures;
+    }
+
+    // a loop rewriting its own operand: 6000 6100 7001 A203 F055 1202, the 61NN loading the last count
+    chip8::Interpreter counting()
+    {
+        const unsigned char rom[] {0x60, 0x00, 0x61, 0x00, 0x70, 0x01, 0xA2, 0x03, 0xF0, 0x55, 0x12, 0x02};
+        chip8::Interpreter machine;
+        machine.copy_rom(rom, sizeof rom);
+        return machine;
+    }
+}
+
+// a child re-forked from another machine at its origin's address copies that machine whole
+int main()
+{
+    chip8::Interpreter origin{loaded(0x11)};
+    chip8::Interpreter child{origin.fork()};
+
+    origin = loaded(0x22);  // the same page write counts as before
+    child.fork_from(origin);
+    expect("after a move into the origin", peek(child, 0x200), 0x22);
+
+    origin.~Interpreter();
+    new (&origin) chip8::Interpreter{loaded(0x33)};
+    child.fork_from(origin);
+    expect("after rebuilding the origin in place", peek(child, 0x200), 0x33);
+
+    std::vector<unsigned char> state(chip8::Interpreter::state_size);
+    loaded(0x44).save_state(state.data());
+    origin.load_state(state.data(), state.size());
+    child.fork_from(origin);
+    expect("after loading a state into the origin", peek(child, 0x200), 0x44);
+
+    const unsigned char byte = 0x55;
+    origin.copy_rom(&byte, 1);  // a write the incremental path catches
+    child.fork_from(origin);
+    expect("after a write into the origin", peek(child, 0x200), 0x55);
+
+    // a fork decodes its ops afresh, and runs on from its origin's decoded state as the origin does
+    chip8::Interpreter warm{counting()};
+    warm.run<chip8::Dispatch::threaded>(1001);
+    chip8::Interpreter fresh{warm.fork()}, copy{warm};
+    fresh.run<chip8::Dispatch::threaded>(1000);
+    copy .run<chip8::Dispatch::threaded>(1000);
+    expect("after running a fork", fresh.registers().Vs[1], copy.registers().Vs[1]);
+
+    return failures != 0;
+}
@@ -0,0 +1,102 @@
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "../src/lockstep.hpp"
+
+namespace
+{
+    constexpr std::uint64_t run_cycles = 100000;
+    constexpr std::size_t   lanes      = 8;
+
+    std::vector<unsigned char> load_rom(const char* path)
+    {
+        std::ifstream stream{path, std::ios::in | std::ios::binary};
+        return {std::istreambuf_iterator<char>{stream}, std::istreambuf_iterator<char>{}};
+    }
+
+    std::vector<unsigned char> state_of(const chip8::Interpreter& machine)
+    {
+        std::vector<unsigned char> state(chip8::Interpreter::state_size);
+        machine.save_state(state.data());
+        return state;
+    }
+
+    /*
+     * Runs the ROM in lockstep and on one interpreter per lane under the same random keys,
+     * returns false at the first lane whose registers, display or memory differ. With
+     * `shared_keys` every lane gets the same keys and only the CXNN seeds tell them apart.
+     */
+    bool compare(const char* path, const std::vector<unsigned char>& rom, unsigned cycles_per_tick, bool shared_keys)
+    {
+        chip8::Interpreter prototype;
+        prototype.copy_font(chip8::fonts::original_chip8);
+        prototype.copy_rom(rom.data(), rom.size());
+        prototype.set_cycles_per_tick(cycles_per_tick);
+
+        chip8::Lockstep lockstep{prototype, lanes};
+        std::vector<chip8::Interpreter> machines(lanes, prototype);
+        std::uint64_t keys[lanes];
+        for (std::size_t lane = 0; lane < lanes; ++lane)
+        {
+            lockstep.seed(lane, lane);
+            machines[lane].seed(lane);
+            keys[lane] = chip8::pcg32_seed(shared_keys ? 0 : lane);
+        }
+
+        std::uint64_t slices = chip8::pcg32_seed(cycles_per_tick);
+        for (std::uint64_t cycle = 0; cycle < run_cycles; )
+        {
+            const std::uint64_t slice = 1 + chip8::pcg32(slices) % 64;
+            lockstep.run(slice);
+            for (chip8::Interpreter& machine : machines)
+                machine.run(slice);
+            cycle += slice;
+
+            for (std::size_t lane = 0; lane < lanes; ++lane)
+            {
+                const std::uint32_t event = chip8::pcg32(keys[lane]);
+                if (event % 4)
+                    continue;
+                lockstep.key_event(lane, event >> 8 & 0xF, event >> 16 & 1);
+                machines[lane].key_event(event >> 8 & 0xF, event >> 16 & 1);
+            }
+
+            for (std::size_t lane = 0; lane < lanes; ++lane)
+            {
+                const chip8::Interpreter lane_machine{lockstep.machine(lane)};
+                if (state_of(lane_machine) == state_of(machines[lane]))
+                    continue;
+                const chip8::Registers a = machines[lane].registers(), b = lane_machine.registers();
+                std::printf("%s, %u cycles per tick, %s keys: lane %zu differs by cycle %llu"
+                            " (PC %03X/%03X, I %03X/%03X, SP %02X/%02X, display %s)\n",
+                            path, cycles_per_tick, shared_keys ? "shared" : "own", lane,
+                            static_cast<unsigned long long>(cycle), b.PC, a.PC, b.I, a.I, b.SP, a.SP,
+                            lane_machine.display_hash() == machines[lane].display_hash() ? "same" : "differs");
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+// every lane of a lockstep run ends each slice in the state its own interpreter does
+int main(int argc, char** argv)
+{
+    int failures = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::vector<unsigned char> rom{load_rom(argv[i])};
+        if (rom.empty() || rom.size() > 4096 - 0x200)
+        {
+            std::printf("%s: not a ROM\n", argv[i]);
+            ++failures;
+            continue;
+        }
+        for (unsigned cycles_per_tick : {1u, 10u})
+            for (bool shared_keys : {true, false})
+                failures += !compare(argv[i], rom, cycles_per_tick, shared_keys);
+    }
+    return failures != 0;
+}